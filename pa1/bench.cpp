@@ -0,0 +1,537 @@
+#include "Camera.hpp"
+#include "ObjParser.hpp"
+#include "Scene.hpp"
+#include "Stats.hpp"
+#include "Timer.hpp"
+#include "Zbuf.hpp"
+#include "global.hpp"
+#include "shaders.hpp"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <numbers>
+#include <omp.h>
+#include <random>
+#include <sstream>
+#include <string>
+#include <vector>
+
+// Rendering methods to benchmark, with their names in reports
+static std::vector<std::pair<rendering_method, std::string>> const methods{
+    {rendering_method::naive, "naive"},
+    {rendering_method::zpyramid, "zpyramid"},
+    {rendering_method::octree, "octree"},
+    {rendering_method::tiled, "tiled"},
+    {rendering_method::deferred, "deferred"},
+    {rendering_method::scanline, "scanline"},
+    {rendering_method::scanline_zpyramid, "scanline-zpyramid"},
+    {rendering_method::masked, "masked"},
+    {rendering_method::coherent, "coherent"},
+};
+// Names of `render_stage`s in reports
+static std::array<char const *, nstages> const stage_names{
+    "transform",
+    "setup",
+    "raster",
+    "resolve",
+};
+
+// Extrinsics and field of view of a camera on the camera path
+struct Pose {
+    vec3 pos, lookat, up;
+    flt  fovy;
+};
+
+void show_help(char const *selfname) {
+    printf("zbench: per-stage benchmark of zbuffer rendering methods\n\n");
+    printf("    usage: %s <objfile> | -s|--synthetic <ntriangles>\n",
+           selfname);
+    printf("                 [--size <size>] [--depth <depth>] "
+           "[--seed <seed>]\n");
+    printf("                 [-c|--cameras <path>] "
+           "[-r|--resolutions <WxH,..>]\n");
+    printf("                 [-m|--methods <name,..>] [-w|--warmup <n>] "
+           "[-n|--repetitions <n>]\n");
+    printf("                 [-o|--output <path>] [-d|--dump <dir>] "
+           "[--reference <dir>]\n");
+    printf("\n");
+    printf("    options:\n");
+    printf("        -h|--help                 Show this message and quit\n");
+    printf("        -s|--synthetic <n>        Benchmark a synthetic scene "
+           "of n triangles,\n"
+           "                                  in layers parallel to the xOy "
+           "plane, inside\n"
+           "                                  [-1, 1] x [-1, 1] x [-1, 0]\n");
+    printf("        --size <size>             Edge length of synthetic "
+           "triangles, default:\n"
+           "                                  each layer covers its square "
+           "about once\n");
+    printf("        --depth <depth>           Number of layers of the "
+           "synthetic scene, i.e.\n"
+           "                                  its depth complexity, "
+           "default: 4\n");
+    printf("        --seed <seed>             Seed of the synthetic scene, "
+           "default: 0\n");
+    printf("        -c|--cameras <path>       Camera path, in the format of "
+           "camera files,\n"
+           "                                  every `position` line starts "
+           "a new camera,\n"
+           "                                  default: a single generated "
+           "camera\n");
+    printf("        -r|--resolutions <WxH,..> Resolutions to render at, "
+           "default: 1920x1080\n");
+    printf("        -m|--methods <name,..>    Rendering methods to "
+           "benchmark, default: all of\n"
+           "                                  ");
+    for (size_t i = 0; i < methods.size(); ++i) {
+        printf("%s%s", methods[i].second.c_str(),
+               i + 1 < methods.size() ? "," : "\n");
+    }
+    printf("        -w|--warmup <n>           Untimed frames per camera, "
+           "default: 2\n");
+    printf("        -n|--repetitions <n>      Timed frames per camera, "
+           "default: 10\n");
+    printf("        -o|--output <path>        Save the report (json format) "
+           "to <path>,\n"
+           "                                  default: zbench.json\n");
+    printf("        -d|--dump <dir>           Save the last frame of each "
+           "method and\n"
+           "                                  resolution as "
+           "<dir>/<method>-<WxH>.ppm\n");
+    printf("        --reference <dir>         Compare the last frame of "
+           "each method and\n"
+           "                                  resolution against images "
+           "dumped in <dir>,\n"
+           "                                  e.g. by a double precision "
+           "build\n");
+    printf("\n");
+}
+
+// Split `s` by commas.
+std::vector<std::string> split(std::string const &s) {
+    std::vector<std::string> ret;
+    std::istringstream       input(s);
+    for (std::string item; std::getline(input, item, ',');) {
+        if (item.size() > 0) {
+            ret.push_back(item);
+        }
+    }
+    return ret;
+}
+
+// Triangles of a synthetic scene.  Each of the `depth` layers is a square
+// [-1, 1] x [-1, 1] at some z in [-1, 0], holding an equal share of the
+// triangles, randomly placed and rotated, all facing +z.
+// @param size: Edge length of triangles, set to the default if not positive
+std::vector<Triangle> synthesize(size_t const &ntris, flt &size,
+                                 int const &depth, unsigned const &seed) {
+    size_t per_layer = std::max<size_t>(ntris / depth, 1);
+    if (size <= 0) {
+        // Area of an equilateral triangle is sqrt(3) / 4 * size^2, make
+        // triangles of a layer cover its area of 4 about once.
+        size = std::sqrt(16 / (std::sqrt(3.0) * per_layer));
+    }
+    // Samples are drawn in double precision regardless of `flt`, so that
+    // builds of all precisions render the same scene from the same seed.
+    std::mt19937                           rng{seed};
+    std::uniform_real_distribution<double> coord{-1, 1},
+        angle{0, 2 * std::numbers::pi};
+    std::vector<Triangle>                  ret;
+    ret.reserve(ntris);
+    for (size_t i = 0; i < ntris; ++i) {
+        int  layer = std::min<int>(i / per_layer, depth - 1);
+        flt  z     = depth > 1 ? -1.0 * layer / (depth - 1) : 0;
+        flt  x     = static_cast<flt>(coord(rng));
+        flt  y     = static_cast<flt>(coord(rng));
+        vec3 center{x, y, z};
+        flt  theta = static_cast<flt>(angle(rng));
+        flt  r     = size / std::sqrt(3.0);
+        std::array<vec3, 3> v;
+        for (int k = 0; k < 3; ++k) {
+            flt phi = theta + k * twopi / 3; // Counter-clockwise
+            v[k]    = center + vec3{r * std::cos(phi), r * std::sin(phi), 0};
+        }
+        ret.emplace_back(v[0], v[1], v[2]);
+    }
+    return ret;
+}
+
+// Load camera poses from `path`.  Lines are in the format of camera files
+// (`position`, `lookat`, `up` and `fov`), each `position` line starts a new
+// pose, other values are inherited from the previous pose.
+std::vector<Pose> load_cameras(std::string const &path, Pose pose) {
+    std::ifstream from(path);
+    if (from.fail()) {
+        errorm("Failed opening file '%s'\n", path.c_str());
+    }
+    std::vector<Pose> ret;
+    for (std::string curline; std::getline(from, curline);) {
+        std::istringstream input(curline);
+        std::string        token;
+        input >> token;
+        if (token.length() == 0 || token[0] == '#') {
+            continue;
+        }
+        if (token[0] == 'p' || token[0] == 'P') {
+            ret.push_back(pose);
+            input >> ret.back().pos.x >> ret.back().pos.y >>
+                ret.back().pos.z;
+        } else if (ret.size() == 0) {
+            errorm("Camera '%s' is not preceded by a position\n",
+                   curline.c_str());
+        } else if (token[0] == 'l' || token[0] == 'L') {
+            input >> ret.back().lookat.x >> ret.back().lookat.y >>
+                ret.back().lookat.z;
+        } else if (token[0] == 'u' || token[0] == 'U') {
+            input >> ret.back().up.x >> ret.back().up.y >> ret.back().up.z;
+        } else if (token[0] == 'f' || token[0] == 'F') {
+            input >> ret.back().fovy;
+        }
+        pose = ret.back();
+    }
+    return ret;
+}
+
+// `s` escaped as the contents of a json string.
+std::string json_escape(std::string const &s) {
+    std::string ret;
+    for (unsigned char c : s) {
+        if (c == '"' || c == '\\') {
+            ret += '\\';
+            ret += c;
+        } else if (c < 0x20) {
+            char buf[8];
+            std::snprintf(buf, sizeof(buf), "\\u%04x", c);
+            ret += buf;
+        } else {
+            ret += c;
+        }
+    }
+    return ret;
+}
+
+// Value at percentile `p` (in [0, 100]) of sorted values, nearest rank.
+flt percentile(std::vector<flt> const &sorted, flt const &p) {
+    size_t rank = std::ceil(p / 100 * sorted.size());
+    return sorted[std::clamp<size_t>(rank, 1, sorted.size()) - 1];
+}
+
+// Fraction of pixels of `img` that differ from the ppm image at `path`,
+// when written with `write_ppm`.  Returns a negative value if the image
+// cannot be read or has a different size.
+flt mismatch(Image const &img, std::string const &path) {
+    std::ifstream from(path, std::ios::binary);
+    std::string   magic;
+    size_t        w, h;
+    int           maxval;
+    from >> magic >> w >> h >> maxval;
+    from.get(); // Single whitespace before the raster
+    if (from.fail() || magic != "P6" || maxval != 255 || w != img.w ||
+        h != img.h) {
+        return -1;
+    }
+    std::vector<unsigned char> buf(3 * w * h);
+    if (!from.read(reinterpret_cast<char *>(buf.data()), buf.size())) {
+        return -1;
+    }
+    // Same gamma table as `write_ppm`
+    std::array<unsigned char, 256> lut;
+    for (int v = 0; v < 256; ++v) {
+        lut[v] = Color(static_cast<unsigned char>(v)).correction(0.6).r;
+    }
+    size_t differ = 0;
+    for (size_t j = 0; j < h; ++j) {
+        unsigned char const *row = buf.data() + 3 * w * j;
+        Color const *        src = &img(0, h - 1 - j);
+        for (size_t i = 0; i < w; ++i) {
+            differ += row[3 * i + 0] != lut[src[i].r] ||
+                      row[3 * i + 1] != lut[src[i].g] ||
+                      row[3 * i + 2] != lut[src[i].b];
+        }
+    }
+    return 1.0 * differ / (w * h);
+}
+
+// Write per-frame averages of counters summed over `frames` frames as a
+// json object.
+void write_counters(std::FILE *f, RenderStats const &s, size_t const &frames) {
+    std::array<std::pair<char const *, uint64_t>, 15> const counters{{
+        {"facing_culled", s.facing_culled},
+        {"frustum_culled", s.frustum_culled},
+        {"pyramid_culled", s.pyramid_culled},
+        {"nodes_visited", s.nodes_visited},
+        {"nodes_culled", s.nodes_culled},
+        {"nodes_queried", s.nodes_queried},
+        {"occluders", s.occluders},
+        {"occlusion_culled", s.occlusion_culled},
+        {"pixels_tested", s.pixels_tested},
+        {"pixels_passed", s.pixels_passed},
+        {"pixels_accepted", s.pixels_accepted},
+        {"shaded", s.shaded},
+        {"setz_steps", s.setz_steps},
+        {"pyramid_tests", s.pyramid_tests},
+        {"lca_levels", s.lca_levels},
+    }};
+    fprintf(f, "{");
+    for (auto const &[name, value] : counters) {
+        fprintf(f, "\"%s\": %.1f, ", name, 1.0 * value / frames);
+    }
+    fprintf(f, "\"average_lca_level\": %.4f}", s.average_lca_level());
+}
+
+// Write summary of `samples` as a json object.
+void write_summary(std::FILE *f, std::vector<flt> samples) {
+    std::sort(samples.begin(), samples.end());
+    flt sum = 0;
+    for (flt const &x : samples) {
+        sum += x;
+    }
+    fprintf(f,
+            "{\"min\": %.4f, \"median\": %.4f, \"p90\": %.4f, "
+            "\"p99\": %.4f, \"max\": %.4f, \"mean\": %.4f}",
+            samples.front(), percentile(samples, 50), percentile(samples, 90),
+            percentile(samples, 99), samples.back(), sum / samples.size());
+}
+
+int main(int argc, char **argv) {
+    // Path to the obj file
+    std::string objfile;
+    // Number of triangles of the synthetic scene, 0 to load `objfile`
+    size_t ntris = 0;
+    // Edge length of synthetic triangles, non-positive for default
+    flt size = 0;
+    // Depth complexity of the synthetic scene
+    int depth = 4;
+    // Random seed of the synthetic scene
+    unsigned seed = 0;
+    // Path to the camera path file
+    std::string camfile;
+    // Resolutions and methods to benchmark
+    std::vector<std::string> resolutions{"1920x1080"};
+    std::vector<std::string> method_names;
+    // Frames rendered per camera before and while timing
+    int warmup = 2, reps = 10;
+    // Path of the report
+    std::string outfile{"zbench.json"};
+    // Directories to save last frames to, and to compare them against
+    std::string dumpdir, refdir;
+
+    /*************************** Parse arguments ****************************/
+    for (int i = 1; i < argc; ++i) {
+        auto value = [&]() -> char const * {
+            if (++i >= argc) {
+                errorm("Missing value of option '%s'\n", argv[i - 1]);
+            }
+            return argv[i];
+        };
+        if (!strcmp(argv[i], "-h") || !strcmp(argv[i], "--help")) {
+            show_help(argv[0]);
+            return 0;
+        } else if (!strcmp(argv[i], "-s") ||
+                   !strcmp(argv[i], "--synthetic")) {
+            ntris = std::max(atol(value()), 1l);
+        } else if (!strcmp(argv[i], "--size")) {
+            size = atof(value());
+        } else if (!strcmp(argv[i], "--depth")) {
+            depth = std::max(atoi(value()), 1);
+        } else if (!strcmp(argv[i], "--seed")) {
+            seed = atol(value());
+        } else if (!strcmp(argv[i], "-c") || !strcmp(argv[i], "--cameras")) {
+            camfile = value();
+        } else if (!strcmp(argv[i], "-r") ||
+                   !strcmp(argv[i], "--resolutions")) {
+            resolutions = split(value());
+        } else if (!strcmp(argv[i], "-m") || !strcmp(argv[i], "--methods")) {
+            method_names = split(value());
+        } else if (!strcmp(argv[i], "-w") || !strcmp(argv[i], "--warmup")) {
+            warmup = std::max(atoi(value()), 0);
+        } else if (!strcmp(argv[i], "-n") ||
+                   !strcmp(argv[i], "--repetitions")) {
+            reps = std::max(atoi(value()), 1);
+        } else if (!strcmp(argv[i], "-o") || !strcmp(argv[i], "--output")) {
+            outfile = value();
+        } else if (!strcmp(argv[i], "-d") || !strcmp(argv[i], "--dump")) {
+            dumpdir = value();
+        } else if (!strcmp(argv[i], "--reference")) {
+            refdir = value();
+        } else if (argv[i][0] == '-') {
+            fprintf(stderr, "Unrecognized option '%s'\n", argv[i]);
+        } else {
+            objfile = argv[i];
+        }
+    }
+    if (objfile.size() == 0 && ntris == 0) {
+        show_help(argv[0]);
+        return 0;
+    }
+    std::vector<std::pair<rendering_method, std::string>> selected;
+    for (auto const &m : methods) {
+        if (method_names.size() == 0 ||
+            std::find(method_names.begin(), method_names.end(), m.second) !=
+                method_names.end()) {
+            selected.push_back(m);
+        }
+    }
+    std::vector<std::pair<int, int>> sizes;
+    for (std::string const &res : resolutions) {
+        int width, height;
+        if (sscanf(res.c_str(), "%dx%d", &width, &height) != 2 ||
+            width <= 0 || height <= 0) {
+            errorm("Invalid resolution '%s'\n", res.c_str());
+        }
+        sizes.emplace_back(width, height);
+    }
+
+    /****************************** Load scene ******************************/
+    Scene       world;
+    std::string source;
+    Pose        pose{vec3{0, 0, 3}, vec3{0}, vec3{0, 1, 0}, 45};
+    if (ntris > 0) {
+        world  = Scene{synthesize(ntris, size, depth, seed)};
+        source = "synthetic";
+    } else {
+        ObjData obj;
+        if (!parse_obj(objfile, obj)) {
+            errorm("Failed to load object from '%s'\n", objfile.c_str());
+        }
+        world          = Scene{obj};
+        source         = objfile;
+        auto [e, g, u] = world.generate_camera();
+        pose.pos       = e;
+        pose.lookat    = e + g;
+        pose.up        = u;
+    }
+    std::vector<Pose> poses{pose};
+    if (camfile.size() > 0) {
+        poses = load_cameras(camfile, pose);
+        if (poses.size() == 0) {
+            errorm("No camera found in '%s'\n", camfile.c_str());
+        }
+    }
+
+    /****************************** Benchmark *******************************/
+    if (dumpdir.size() > 0) {
+        std::error_code ec;
+        std::filesystem::create_directories(dumpdir, ec);
+        if (ec) {
+            errorm("Failed to create directory '%s': %s\n", dumpdir.c_str(),
+                   ec.message().c_str());
+        }
+    }
+    std::FILE *f = std::fopen(outfile.c_str(), "w");
+    if (f == nullptr) {
+        errorm("Failed to open '%s'\n", outfile.c_str());
+    }
+    fprintf(f, "{\n");
+    fprintf(f,
+            "  \"scene\": {\"source\": \"%s\", \"triangles\": %zu, "
+            "\"size\": %.6f, \"depth\": %d, \"seed\": %u},\n",
+            json_escape(source).c_str(), world.triangles().size(), size,
+            ntris > 0 ? depth : 0, seed);
+    fprintf(f,
+            "  \"threads\": %d, \"cameras\": %zu, \"warmup\": %d, "
+            "\"repetitions\": %d,\n",
+            omp_get_max_threads(), poses.size(), warmup, reps);
+    // Precision is chosen at build time, see `ZBUF_FLOAT` and
+    // `ZBUF_FIXED_DEPTH` in CMakeLists.txt.
+    fprintf(f, "  \"precision\": {\"flt\": \"%s\", \"depth\": \"%s\"},\n",
+            sizeof(flt) == sizeof(float) ? "float" : "double",
+#ifdef ZBUF_FIXED_DEPTH
+            "fixed24"
+#else
+            "flt"
+#endif
+    );
+    fprintf(f, "  \"results\": [");
+    Zbuf  zbuf{world};
+    Timer timer;
+    bool  first = true;
+    zbuf.set_shader(shdr::normal_shader);
+    for (auto const &[width, height] : sizes) {
+        zbuf.init_viewport(width, height);
+        for (auto const &[method, name] : selected) {
+            // Samples of each stage and of whole frames
+            std::array<std::vector<flt>, nstages> stages;
+            std::vector<flt>                      totals;
+            // Counters summed over timed frames
+            RenderStats counted;
+            for (Pose const &p : poses) {
+                Camera camera{p.pos,
+                              p.fovy,
+                              static_cast<flt>(1.0 * width / height),
+                              -.1,
+                              -50,
+                              glm::normalize(p.lookat - p.pos),
+                              glm::normalize(p.up)};
+                zbuf.init_cam(camera);
+                zbuf.set_model_transformation(glm::identity<mat4>());
+                for (int r = 0; r < warmup + reps; ++r) {
+                    zbuf.reset();
+                    timer.start();
+                    zbuf.render(method);
+                    timer.end();
+                    if (r < warmup) {
+                        continue;
+                    }
+                    totals.push_back(timer.elapsedms());
+                    counted += zbuf.frame_stats();
+                    for (int s = 0; s < nstages; ++s) {
+                        stages[s].push_back(zbuf.stage_times()[s]);
+                    }
+                }
+            }
+            std::vector<flt> sorted = totals;
+            std::sort(sorted.begin(), sorted.end());
+            msg("%-17s %dx%d: median %.2f ms, p90 %.2f ms\n", name.c_str(),
+                width, height, percentile(sorted, 50),
+                percentile(sorted, 90));
+            fprintf(f, "%s\n    {\"method\": \"%s\", \"resolution\": "
+                       "\"%dx%d\", \"frames\": %zu,\n",
+                    first ? "" : ",", name.c_str(), width, height,
+                    totals.size());
+            fprintf(f, "     \"total\": ");
+            write_summary(f, totals);
+            fprintf(f, ",\n     \"stages\": {");
+            for (int s = 0; s < nstages; ++s) {
+                fprintf(f, "%s\n       \"%s\": ", s ? "," : "",
+                        stage_names[s]);
+                write_summary(f, stages[s]);
+            }
+            fprintf(f, "}");
+            if (STATISTICS) {
+                fprintf(f, ",\n     \"counters\": ");
+                write_counters(f, counted, totals.size());
+            }
+            // Last frame, i.e. of the last camera
+            std::string frame = name + "-" + std::to_string(width) + "x" +
+                                std::to_string(height) + ".ppm";
+            if (refdir.size() > 0) {
+                flt m = mismatch(zbuf.image(), refdir + "/" + frame);
+                if (m < 0) {
+                    fprintf(stderr, "Failed to compare against '%s/%s'\n",
+                            refdir.c_str(), frame.c_str());
+                } else {
+                    msg("%-17s %dx%d: %.4f%% pixels differ from "
+                        "reference\n",
+                        name.c_str(), width, height, 100 * m);
+                    fprintf(f, ",\n     \"mismatch\": %.6f", m);
+                }
+            }
+            if (dumpdir.size() > 0) {
+                write_ppm(dumpdir + "/" + frame, zbuf.image());
+            }
+            fprintf(f, "}");
+            first = false;
+        }
+    }
+    fprintf(f, "\n  ]\n}\n");
+    std::fclose(f);
+    msg("Report saved in %s\n", outfile.c_str());
+    return 0;
+}
+
+// Author: Blurgy <gy@blurgy.xyz>
+// Date:   Oct 17 2026, 19:10 [CST]
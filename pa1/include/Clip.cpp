@@ -0,0 +1,139 @@
+#include "Clip.hpp"
+
+// Vertex of a polygon being clipped.
+struct ClipVertex {
+    // Clip-space coordinate
+    vec4 pos;
+    // Barycentric coordinate with respect to the original triangle
+    vec3 bary;
+};
+
+// Signed distance of clip-space coordinate `c` to plane `p`, non-negative
+// values are on the inner side.
+static flt distance(vec4 const &c, unsigned const &p) {
+    switch (p) {
+    case clip_left:
+        return c.x + guard_band * c.w;
+    case clip_right:
+        return guard_band * c.w - c.x;
+    case clip_bottom:
+        return c.y + guard_band * c.w;
+    case clip_top:
+        return guard_band * c.w - c.y;
+    case clip_near:
+        return ndc_near * c.w - c.z;
+    default:
+        errorm("Unknown clipping plane %u\n", p);
+    }
+}
+
+vec4 to_clip(vec3 const &p, mat4 const &mvp) {
+    return -(vec4{p.x, p.y, p.z, 1} * mvp);
+}
+
+unsigned outcode(vec4 const &c, flt const &band) {
+    unsigned ret{0};
+    if (c.x < -band * c.w) {
+        ret |= clip_left;
+    }
+    if (c.x > band * c.w) {
+        ret |= clip_right;
+    }
+    if (c.y < -band * c.w) {
+        ret |= clip_bottom;
+    }
+    if (c.y > band * c.w) {
+        ret |= clip_top;
+    }
+    if (c.z > ndc_near * c.w) {
+        ret |= clip_near;
+    }
+    return ret;
+}
+
+// Assemble a view-space triangle from 3 clipped vertices, attributes are
+// interpolated from the original triangle `t`.
+static Triangle assemble(Triangle const &t, ClipVertex const &a,
+                         ClipVertex const &b, ClipVertex const &c) {
+    Triangle                  ret(t);
+    std::array<ClipVertex, 3> verts{a, b, c};
+    for (int i = 0; i < 3; ++i) {
+        vec4 const &p = verts[i].pos;
+        vec3 const &w = verts[i].bary;
+        ret.v[i]      = vec3{p.x / p.w, p.y / p.w, p.z / p.w};
+        ret.nor[i] = w[0] * t.nor[0] + w[1] * t.nor[1] + w[2] * t.nor[2];
+        ret.tex[i] = w[0] * t.tex[0] + w[1] * t.tex[1] + w[2] * t.tex[2];
+        ret.col[i] = Color{
+            static_cast<unsigned char>(.5 + w[0] * t.col[0].r +
+                                       w[1] * t.col[1].r + w[2] * t.col[2].r),
+            static_cast<unsigned char>(.5 + w[0] * t.col[0].g +
+                                       w[1] * t.col[1].g + w[2] * t.col[2].g),
+            static_cast<unsigned char>(.5 + w[0] * t.col[0].b +
+                                       w[1] * t.col[1].b + w[2] * t.col[2].b),
+        };
+    }
+    return ret;
+}
+
+void clip(Triangle const &t, mat4 const &mvp, std::vector<Triangle> &out) {
+    clip(t, {to_clip(t.a(), mvp), to_clip(t.b(), mvp), to_clip(t.c(), mvp)},
+         out);
+}
+
+void clip(Triangle const &t, std::array<vec4, 3> const &c,
+          std::vector<Triangle> &out) {
+    std::array<unsigned, 3> codes{outcode(c[0]), outcode(c[1]),
+                                  outcode(c[2])};
+    // Trivial reject: all vertices are outside the same frustum plane.
+    if (codes[0] & codes[1] & codes[2]) {
+        return;
+    }
+    // Trivial accept: all vertices are inside the guard band.
+    unsigned band = outcode(c[0], guard_band) | outcode(c[1], guard_band) |
+                    outcode(c[2], guard_band);
+    if (band == 0) {
+        out.push_back(assemble(t, {c[0], vec3{1, 0, 0}},
+                               {c[1], vec3{0, 1, 0}}, {c[2], vec3{0, 0, 1}}));
+        return;
+    }
+    // Sutherland-Hodgman clipping against planes the triangle crosses.  A
+    // triangle clipped by 5 planes has at most 8 vertices.
+    std::vector<ClipVertex> poly{
+        {c[0], vec3{1, 0, 0}},
+        {c[1], vec3{0, 1, 0}},
+        {c[2], vec3{0, 0, 1}},
+    };
+    std::vector<ClipVertex> next;
+    poly.reserve(8), next.reserve(8);
+    for (unsigned p = clip_left; p <= clip_near; p <<= 1) {
+        if (!(band & p)) {
+            continue;
+        }
+        next.clear();
+        for (size_t i = 0; i < poly.size(); ++i) {
+            ClipVertex const &cur = poly[i];
+            ClipVertex const &nxt = poly[(i + 1) % poly.size()];
+            flt               dc  = distance(cur.pos, p);
+            flt               dn  = distance(nxt.pos, p);
+            if (dc >= 0) {
+                next.push_back(cur);
+            }
+            if ((dc >= 0) != (dn >= 0)) {
+                flt s = dc / (dc - dn);
+                next.push_back({cur.pos + s * (nxt.pos - cur.pos),
+                                cur.bary + s * (nxt.bary - cur.bary)});
+            }
+        }
+        std::swap(poly, next);
+        if (poly.size() < 3) {
+            return;
+        }
+    }
+    // Triangulate the clipped (convex) polygon as a fan.
+    for (size_t i = 1; i + 1 < poly.size(); ++i) {
+        out.push_back(assemble(t, poly[0], poly[i], poly[i + 1]));
+    }
+}
+
+// Author: Blurgy <gy@blurgy.xyz>
+// Date:   Oct 17 2026, 14:05 [CST]
@@ -0,0 +1,51 @@
+#pragma once
+
+#include "Triangle.hpp"
+#include "global.hpp"
+
+#include <array>
+#include <vector>
+
+// Projection of `Zbuf` maps the near clipping plane to this z value in
+// normalized device coordinates.  There is no far clipping plane: depth
+// values of points behind z_far still decrease monotonically, so nothing is
+// culled by distance.
+flt constexpr ndc_near = .5;
+
+// Guard band, in multiples of the viewport's half width and half height.
+// Triangles inside the guard band are rasterized without clipping, the
+// rasterizer only visits on-screen pixels anyway.
+flt constexpr guard_band = 4;
+
+// Frustum planes, as bits of an outcode.
+enum clip_plane : unsigned {
+    clip_left   = 1 << 0, // x < -w
+    clip_right  = 1 << 1, // x > w
+    clip_bottom = 1 << 2, // y < -w
+    clip_top    = 1 << 3, // y > w
+    clip_near   = 1 << 4, // z > ndc_near * w
+};
+
+// Homogeneous (clip-space) coordinate of world-space point `p`.  The
+// coordinate is negated so that w is positive in front of the camera.
+vec4 to_clip(vec3 const &p, mat4 const &mvp);
+
+// Bit mask of frustum planes that clip-space coordinate `c` lies outside
+// of.  Left, right, bottom and top planes are pushed outwards by `band`.
+unsigned outcode(vec4 const &c, flt const &band = 1);
+
+// Clipping stage.  Transforms world-space triangle `t` with `mvp`, clips it
+// in homogeneous coordinates, and appends resulting view-space triangles
+// (perspective divided, like `Triangle::operator*`) to `out`.
+//  - Triangles entirely outside one frustum plane are dropped;
+//  - Triangles inside the guard band are kept as is;
+//  - Other triangles are clipped against the near plane and the guard
+//    band, attributes of new vertices are interpolated in clip space.
+void clip(Triangle const &t, mat4 const &mvp, std::vector<Triangle> &out);
+// Clipping stage, for triangle `t` whose vertices are already transformed
+// to clip-space coordinates `c`.
+void clip(Triangle const &t, std::array<vec4, 3> const &c,
+          std::vector<Triangle> &out);
+
+// Author: Blurgy <gy@blurgy.xyz>
+// Date:   Oct 17 2026, 14:05 [CST]
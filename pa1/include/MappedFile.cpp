@@ -0,0 +1,90 @@
+#include "MappedFile.hpp"
+#include "Profiler.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <fcntl.h>
+#include <omp.h>
+#include <vector>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+MappedFile::MappedFile() : ptr{nullptr}, len{0} {}
+MappedFile::MappedFile(std::string const &path) : ptr{nullptr}, len{0} {
+    int fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+        return;
+    }
+    struct stat st;
+    if (fstat(fd, &st) == 0 && st.st_size > 0) {
+        void *p = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (p != MAP_FAILED) {
+            this->ptr = static_cast<char const *>(p);
+            this->len = st.st_size;
+        }
+    }
+    // The mapping stays valid after the descriptor is closed.
+    close(fd);
+}
+MappedFile::~MappedFile() {
+    if (this->ptr != nullptr) {
+        munmap(const_cast<char *>(this->ptr), this->len);
+    }
+}
+
+bool MappedFile::valid() const { return this->ptr != nullptr; }
+
+char const *MappedFile::data() const { return this->ptr; }
+
+size_t const &MappedFile::size() const { return this->len; }
+
+uint64_t fnv1a(void const *p, size_t const &len) {
+    unsigned char const *bytes = static_cast<unsigned char const *>(p);
+    uint64_t             h     = 0xcbf29ce484222325ull;
+    for (size_t i = 0; i < len; ++i) {
+        h ^= bytes[i];
+        h *= 0x100000001b3ull;
+    }
+    return h;
+}
+
+// Bytes per block of `hash_file`
+static size_t constexpr hash_block = 1 << 20;
+
+// FNV-1a hash of `len` bytes starting at `p`, taken in 64-bit words.
+static uint64_t fnv1a_wide(char const *p, size_t const &len) {
+    uint64_t h = 0xcbf29ce484222325ull;
+    size_t   i = 0;
+    for (; i + sizeof(uint64_t) <= len; i += sizeof(uint64_t)) {
+        uint64_t word;
+        std::memcpy(&word, p + i, sizeof(word));
+        h ^= word;
+        h *= 0x100000001b3ull;
+    }
+    for (; i < len; ++i) {
+        h ^= static_cast<unsigned char>(p[i]);
+        h *= 0x100000001b3ull;
+    }
+    return h;
+}
+
+uint64_t hash_file(std::string const &path) {
+    profm("hash file");
+    MappedFile f{path};
+    if (!f.valid()) {
+        return 0;
+    }
+    size_t                nblocks = (f.size() + hash_block - 1) / hash_block;
+    std::vector<uint64_t> hashes(nblocks);
+#pragma omp parallel for
+    for (size_t b = 0; b < nblocks; ++b) {
+        size_t first = b * hash_block;
+        size_t len   = std::min(hash_block, f.size() - first);
+        hashes[b]    = fnv1a_wide(f.data() + first, len);
+    }
+    return fnv1a(hashes.data(), nblocks * sizeof(uint64_t));
+}
+
+// Author: Blurgy <gy@blurgy.xyz>
+// Date:   Oct 17 2026, 16:20 [CST]
@@ -0,0 +1,39 @@
+#pragma once
+
+#include "global.hpp"
+
+#include <cstdint>
+#include <string>
+
+// Read-only memory mapping of a whole file.  The mapping lives as long as
+// the object, an empty or nonexistent file maps to nothing.
+class MappedFile {
+  private:
+    char const *ptr;
+    size_t      len;
+
+  public:
+    MappedFile();
+    MappedFile(std::string const &path);
+    MappedFile(MappedFile const &) = delete;
+    MappedFile &operator=(MappedFile const &) = delete;
+    ~MappedFile();
+
+    // Whether the file has been mapped.
+    bool valid() const;
+    // First byte of the mapped file.
+    char const *data() const;
+    // Size of the mapped file, in bytes.
+    size_t const &size() const;
+};
+
+// 64-bit FNV-1a hash of `len` bytes starting at `p`.
+uint64_t fnv1a(void const *p, size_t const &len);
+
+// Hash of the contents of the file at `path`, returns 0 if the file cannot
+// be read.  The file is split into blocks that are hashed in parallel, 8
+// bytes at a time, the hashes of the blocks are then hashed in order.
+uint64_t hash_file(std::string const &path);
+
+// Author: Blurgy <gy@blurgy.xyz>
+// Date:   Oct 17 2026, 16:20 [CST]
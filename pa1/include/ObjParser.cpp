@@ -0,0 +1,343 @@
+#include "ObjParser.hpp"
+#include "MappedFile.hpp"
+#include "Profiler.hpp"
+
+#include <algorithm>
+#include <charconv>
+#include <cstdio>
+#include <limits>
+#include <omp.h>
+#include <string_view>
+#include <unordered_map>
+
+// Marks a missing attribute index while parsing.
+static int constexpr missing = std::numeric_limits<int>::min();
+
+// Parse result of a chunk of the file.  Positive indices in obj files are
+// absolute, negative indices count back from the last attribute read so
+// far, which is unknown to a chunk until all previous chunks are parsed.
+// Such indices are stored relative to the chunk's first attribute and
+// flagged, until the merging pass offsets them.
+struct ObjChunk {
+    std::vector<flt>      positions, normals, texcoords;
+    std::vector<ObjIndex> corners;
+    // Bit 0/1/2 set if v/vt/vn of the corner is relative to the chunk
+    std::vector<unsigned char> relative;
+    // Index into `material_names` of each triangle, -1 for triangles
+    // before the first `usemtl` of the chunk
+    std::vector<int>         material_ids;
+    std::vector<std::string> material_names;
+    std::vector<std::string> mtllibs;
+    // Material used at the end of the chunk, -1 if not changed in the chunk
+    int last_material{-1};
+    // Number of lines in the chunk
+    size_t lines{0};
+    // Number of malformed statements skipped, and the line (counted from
+    // the chunk's first line) of the first one
+    size_t malformed{0}, first_malformed{0};
+};
+
+namespace {
+
+bool is_blank(char const &c) { return c == ' ' || c == '\t' || c == '\r'; }
+// Comments run from '#' to the end of line.
+bool is_eol(char const &c) { return c == '\n' || c == '#'; }
+
+void skip_blanks(char const *&p, char const *end) {
+    while (p < end && is_blank(*p)) {
+        ++p;
+    }
+}
+
+// Next whitespace-delimited token on current line, empty at end of line or
+// at a comment.
+std::string_view token(char const *&p, char const *end) {
+    skip_blanks(p, end);
+    char const *begin = p;
+    while (p < end && !is_eol(*p) && !is_blank(*p)) {
+        ++p;
+    }
+    return std::string_view(begin, p - begin);
+}
+
+// Rest of current line before any comment, without surrounding
+// whitespaces.
+std::string_view rest(char const *&p, char const *end) {
+    skip_blanks(p, end);
+    char const *begin = p;
+    while (p < end && !is_eol(*p)) {
+        ++p;
+    }
+    char const *last = p;
+    while (last > begin && is_blank(last[-1])) {
+        --last;
+    }
+    return std::string_view(begin, last - begin);
+}
+
+// Parse `n` numbers on current line and append them to `out`, fewer
+// numbers are padded with 0.  Exactly `n` numbers are appended even if the
+// numbers are malformed, so that indices of later attributes stay valid.
+bool numbers(char const *&p, char const *end, int const &n,
+             std::vector<flt> &out) {
+    bool ok = true;
+    for (int i = 0; i < n; ++i) {
+        skip_blanks(p, end);
+        if (p < end && *p == '+') {
+            ++p;
+        }
+        flt value{0};
+        if (ok && p < end && !is_eol(*p)) {
+            auto [ptr, ec] = std::from_chars(p, end, value);
+            if (ec != std::errc{}) {
+                ok    = false;
+                value = 0;
+            } else {
+                p = ptr;
+            }
+        }
+        out.push_back(value);
+    }
+    return ok;
+}
+
+// Parse an attribute index of a face corner.  `count` is the number of
+// such attributes read so far in the chunk.
+bool corner_index(std::string_view const &s, size_t &pos, size_t const &count,
+                  int &idx, bool &relative) {
+    size_t begin = pos;
+    while (pos < s.size() && s[pos] != '/') {
+        ++pos;
+    }
+    if (pos == begin) {
+        idx = missing;
+        return true;
+    }
+    int value;
+    auto [ptr, ec] = std::from_chars(s.data() + begin, s.data() + pos, value);
+    if (ec != std::errc{} || ptr != s.data() + pos || value == 0) {
+        return false;
+    }
+    relative = value < 0;
+    idx      = relative ? static_cast<int>(count) + value : value - 1;
+    return true;
+}
+
+void parse_chunk(char const *p, char const *end, ObjChunk &chunk) {
+    std::vector<ObjIndex>      polygon;
+    std::vector<unsigned char> polygon_relative;
+    int                        material = -1;
+    while (p < end) {
+        // Whether current statement is well-formed
+        bool             ok  = true;
+        std::string_view key = token(p, end);
+        if (key == "v") {
+            ok = numbers(p, end, 3, chunk.positions);
+        } else if (key == "vt") {
+            ok = numbers(p, end, 2, chunk.texcoords);
+        } else if (key == "vn") {
+            ok = numbers(p, end, 3, chunk.normals);
+        } else if (key == "f") {
+            polygon.clear();
+            polygon_relative.clear();
+            for (std::string_view s = token(p, end); s.size() > 0 && ok;
+                 s = token(p, end)) {
+                ObjIndex      c;
+                bool          rel[3]{false, false, false};
+                size_t        pos = 0;
+                unsigned char r   = 0;
+                ok   = corner_index(s, pos, chunk.positions.size() / 3, c.v,
+                                    rel[0]) &&
+                       c.v != missing;
+                c.vt = c.vn = missing;
+                if (ok && pos < s.size()) {
+                    ++pos;
+                    ok = corner_index(s, pos, chunk.texcoords.size() / 2,
+                                      c.vt, rel[1]);
+                }
+                if (ok && pos < s.size()) {
+                    ++pos;
+                    ok = corner_index(s, pos, chunk.normals.size() / 3, c.vn,
+                                      rel[2]);
+                }
+                for (int k = 0; k < 3; ++k) {
+                    r |= rel[k] << k;
+                }
+                polygon.push_back(c);
+                polygon_relative.push_back(r);
+            }
+            // Triangulate the polygon as a fan, malformed faces are dropped.
+            for (size_t i = 1; ok && i + 1 < polygon.size(); ++i) {
+                for (size_t const &j : {size_t{0}, i, i + 1}) {
+                    chunk.corners.push_back(polygon[j]);
+                    chunk.relative.push_back(polygon_relative[j]);
+                }
+                chunk.material_ids.push_back(material);
+            }
+        } else if (key == "usemtl") {
+            std::string              name{rest(p, end)};
+            std::vector<std::string> &names = chunk.material_names;
+            auto it  = std::find(names.begin(), names.end(), name);
+            material = it - names.begin();
+            if (it == names.end()) {
+                names.push_back(name);
+            }
+            chunk.last_material = material;
+        } else if (key == "mtllib") {
+            for (std::string_view s = token(p, end); s.size() > 0;
+                 s = token(p, end)) {
+                chunk.mtllibs.emplace_back(s);
+            }
+        }
+        if (!ok && chunk.malformed++ == 0) {
+            chunk.first_malformed = chunk.lines;
+        }
+        // Skip the rest of the line, including comments and statements
+        // that are not handled.
+        while (p < end && *p != '\n') {
+            ++p;
+        }
+        if (p < end) {
+            ++p;
+        }
+        ++chunk.lines;
+    }
+}
+
+} // namespace
+
+bool parse_obj(std::string const &path, ObjData &out) {
+    profm("parse obj");
+    MappedFile f{path};
+    if (!f.valid()) {
+        return false;
+    }
+    char const *begin = f.data();
+    char const *end   = begin + f.size();
+
+    // Split the file into chunks of at least 1 MiB, each chunk starts at
+    // the beginning of a line.
+    size_t nchunks = std::clamp<size_t>(f.size() >> 20, 1,
+                                        8 * omp_get_max_threads());
+    std::vector<char const *> bounds(nchunks + 1);
+    for (size_t k = 0; k <= nchunks; ++k) {
+        char const *p = begin + f.size() * k / nchunks;
+        if (k > 0 && k < nchunks) {
+            p = std::find(p, end, '\n');
+            p = std::min(p + 1, end);
+        }
+        bounds[k] = p;
+    }
+    std::vector<ObjChunk> chunks(nchunks);
+#pragma omp parallel for schedule(dynamic)
+    for (size_t k = 0; k < nchunks; ++k) {
+        if (bounds[k] < bounds[k + 1]) {
+            profm("parse chunk");
+            parse_chunk(bounds[k], bounds[k + 1], chunks[k]);
+        }
+    }
+
+    // Malformed statements are skipped, report the first one.
+    size_t malformed = 0, line = 0, first_malformed = 0;
+    for (ObjChunk const &c : chunks) {
+        if (malformed == 0 && c.malformed > 0) {
+            first_malformed = line + c.first_malformed + 1;
+        }
+        malformed += c.malformed;
+        line += c.lines;
+    }
+    if (malformed > 0) {
+        fprintf(stderr,
+                "Skipped %zu malformed statement(s) in '%s', the first one "
+                "on line %zu\n",
+                malformed, path.c_str(), first_malformed);
+    }
+
+    // Offsets of each chunk's attributes and triangles in merged arrays
+    std::vector<std::array<size_t, 4>> base(nchunks + 1);
+    base[0] = {0, 0, 0, 0};
+    for (size_t k = 0; k < nchunks; ++k) {
+        base[k + 1] = {
+            base[k][0] + chunks[k].positions.size(),
+            base[k][1] + chunks[k].texcoords.size(),
+            base[k][2] + chunks[k].normals.size(),
+            base[k][3] + chunks[k].corners.size(),
+        };
+    }
+    // Global material ids of each chunk's local materials, and the
+    // material in use at the beginning of each chunk
+    std::unordered_map<std::string, int> material_map;
+    std::vector<std::vector<int>>        material_ids(nchunks);
+    std::vector<int>                     first_material(nchunks);
+    out.material_names.clear();
+    out.mtllibs.clear();
+    int material = -1;
+    for (size_t k = 0; k < nchunks; ++k) {
+        first_material[k] = material;
+        for (std::string const &name : chunks[k].material_names) {
+            auto [it, inserted] =
+                material_map.try_emplace(name, out.material_names.size());
+            if (inserted) {
+                out.material_names.push_back(name);
+            }
+            material_ids[k].push_back(it->second);
+        }
+        if (chunks[k].last_material >= 0) {
+            material = material_ids[k][chunks[k].last_material];
+        }
+        out.mtllibs.insert(out.mtllibs.end(), chunks[k].mtllibs.begin(),
+                           chunks[k].mtllibs.end());
+    }
+
+    std::array<size_t, 4> const &total = base[nchunks];
+    out.positions.resize(total[0]);
+    out.texcoords.resize(total[1]);
+    out.normals.resize(total[2]);
+    out.corners.resize(total[3]);
+    out.material_ids.resize(total[3] / 3);
+    std::array<int, 3> const count{
+        static_cast<int>(total[0] / 3),
+        static_cast<int>(total[1] / 2),
+        static_cast<int>(total[2] / 3),
+    };
+    bool ok = true;
+#pragma omp parallel for schedule(dynamic) reduction(&& : ok)
+    for (size_t k = 0; k < nchunks; ++k) {
+        ObjChunk const &c = chunks[k];
+        std::copy(c.positions.begin(), c.positions.end(),
+                  out.positions.begin() + base[k][0]);
+        std::copy(c.texcoords.begin(), c.texcoords.end(),
+                  out.texcoords.begin() + base[k][1]);
+        std::copy(c.normals.begin(), c.normals.end(),
+                  out.normals.begin() + base[k][2]);
+        std::array<int, 3> const offset{
+            static_cast<int>(base[k][0] / 3),
+            static_cast<int>(base[k][1] / 2),
+            static_cast<int>(base[k][2] / 3),
+        };
+        for (size_t i = 0; i < c.corners.size(); ++i) {
+            std::array<int, 3> idx{c.corners[i].v, c.corners[i].vt,
+                                   c.corners[i].vn};
+            for (int j = 0; j < 3; ++j) {
+                if (idx[j] == missing) {
+                    idx[j] = -1;
+                    continue;
+                }
+                if (c.relative[i] >> j & 1) {
+                    idx[j] += offset[j];
+                }
+                ok = ok && 0 <= idx[j] && idx[j] < count[j];
+            }
+            out.corners[base[k][3] + i] = ObjIndex{idx[0], idx[1], idx[2]};
+        }
+        for (size_t t = 0; t < c.material_ids.size(); ++t) {
+            int const &m = c.material_ids[t];
+            out.material_ids[base[k][3] / 3 + t] =
+                m < 0 ? first_material[k] : material_ids[k][m];
+        }
+    }
+    return ok;
+}
+
+// Author: Blurgy <gy@blurgy.xyz>
+// Date:   Oct 17 2026, 18:02 [CST]
@@ -0,0 +1,51 @@
+#pragma once
+
+#include "global.hpp"
+
+#include <array>
+#include <string>
+#include <vector>
+
+// Indices of a face corner's position, texture coordinate and normal, zero
+// based.  Missing attributes are -1.
+struct ObjIndex {
+    int v, vt, vn;
+};
+
+// Geometry of an obj file, with polygons triangulated as fans.
+struct ObjData {
+    // Vertex attributes, 3 values per position/normal, 2 values per
+    // texture coordinate
+    std::vector<flt> positions, normals, texcoords;
+    // Every 3 consecutive corners make up a triangle
+    std::vector<ObjIndex> corners;
+    // Index into `material_names` of each triangle, -1 for triangles before
+    // the first `usemtl` statement
+    std::vector<int> material_ids;
+    // Names of materials in the order they are first used
+    std::vector<std::string> material_names;
+    // Material libraries referred by `mtllib` statements
+    std::vector<std::string> mtllibs;
+
+    // Number of triangles.
+    size_t ntriangles() const { return this->corners.size() / 3; }
+    // Position of vertex `i` of triangle `t`.
+    vec3 position(size_t const &t, int const &i) const {
+        int const &v = this->corners[3 * t + i].v;
+        return vec3{this->positions[3 * v + 0], this->positions[3 * v + 1],
+                    this->positions[3 * v + 2]};
+    }
+};
+
+// Parse obj file `path` into `out`.  The file is memory mapped and split
+// into chunks at line boundaries, chunks are parsed in parallel and then
+// merged.  Handles `v`, `vt`, `vn`, `f` (with negative, i.e. relative,
+// indices), `usemtl` and `mtllib` statements, other statements and
+// comments ('#' to the end of line) are ignored.  Malformed statements are
+// skipped with a warning: unparsable vertex attributes read as zeros,
+// faces with unparsable indices are dropped.
+// @return: Whether the file is read and all face indices are in range
+bool parse_obj(std::string const &path, ObjData &out);
+
+// Author: Blurgy <gy@blurgy.xyz>
+// Date:   Oct 17 2026, 18:02 [CST]
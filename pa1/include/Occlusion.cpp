@@ -0,0 +1,131 @@
+#include "Occlusion.hpp"
+
+// Occluder depth values are pushed this much farther, so that depth
+// values computed from the depth plane never exceed those of the
+// occluders' own vertices because of rounding errors.
+static flt constexpr occluder_margin = 1e-5;
+
+OcclusionBuffer::OcclusionBuffer() : h{0}, w{0}, cols{0}, rows{0} {}
+OcclusionBuffer::OcclusionBuffer(size_t const &height, size_t const &width)
+    : h{height}, w{width}, cols{(width + raster_block - 1) / raster_block},
+      rows{(height + raster_block - 1) / raster_block} {
+    this->clear();
+}
+
+void OcclusionBuffer::clear() {
+    this->tiles.assign(this->cols * this->rows,
+                       Tile{0, std::numeric_limits<flt>::lowest(),
+                            std::numeric_limits<flt>::lowest()});
+}
+
+void OcclusionBuffer::draw(Raster const &r) {
+    int const b  = raster_block;
+    int       x0 = std::max(r.xmin, 0), x1 = std::min<int>(r.xmax, this->w);
+    int       y0 = std::max(r.ymin, 0), y1 = std::min<int>(r.ymax, this->h);
+    for (int ty = y0 / b; ty * b < y1; ++ty) {
+        int jmin = std::max(ty * b, y0), jmax = std::min(ty * b + b, y1);
+        for (int tx = x0 / b; tx * b < x1; ++tx) {
+            int imin = std::max(tx * b, x0), imax = std::min(tx * b + b, x1);
+            coverage cov = r.classify(imin, jmin, imax, jmax);
+            if (cov == coverage::outside) {
+                continue;
+            }
+            // Farthest depth of the covered pixels, at the corner pixel
+            // centers, see `Zbuf::_nearer`.
+            flt xa = .5 + imin, xb = .5 + imax - 1;
+            flt ya = .5 + jmin, yb = .5 + jmax - 1;
+            std::array<flt, 4> iz{r.iz(xa, ya), r.iz(xb, ya), r.iz(xa, yb),
+                                  r.iz(xb, yb)};
+            flt  z = std::numeric_limits<flt>::max();
+            bool bounded = true;
+            for (flt const &v : iz) {
+                bounded = bounded && v * iz[0] > 0;
+                z       = std::min(z, 1 / v);
+            }
+            if (!bounded) {
+                continue;
+            }
+            // Coverage of pixel centers, bit (j * b + i) for pixel (i, j)
+            // of the tile.  Edge values are stepped incrementally, as in
+            // `Zbuf::_raster`.
+            uint64_t m   = 0;
+            uint64_t row = ((uint64_t{1} << (imax - imin)) - 1)
+                           << (imin - tx * b);
+            std::array<int64_t, 3> erow{r.edge(0, imin, jmin),
+                                        r.edge(1, imin, jmin),
+                                        r.edge(2, imin, jmin)};
+            for (int j = jmin; j < jmax; ++j) {
+                int shift = (j - ty * b) * b;
+                if (cov == coverage::inside) {
+                    m |= row << shift;
+                    continue;
+                }
+                std::array<int64_t, 3> e = erow;
+                for (int i = imin; i < imax; ++i) {
+                    if (e[0] > 0 && e[1] > 0 && e[2] > 0) {
+                        m |= uint64_t{1} << (shift + i - tx * b);
+                    }
+                    e[0] += r.a[0], e[1] += r.a[1], e[2] += r.a[2];
+                }
+                erow[0] += r.b[0], erow[1] += r.b[1], erow[2] += r.b[2];
+            }
+            if (m != 0) {
+                this->merge(tx, ty, m, z - occluder_margin);
+            }
+        }
+    }
+}
+
+bool OcclusionBuffer::visible(size_t const &x0, size_t const &y0,
+                              size_t const &x1, size_t const &y1,
+                              flt const &nearest_z) const {
+    for (size_t ty = y0 / raster_block; ty <= y1 / raster_block; ++ty) {
+        for (size_t tx = x0 / raster_block; tx <= x1 / raster_block; ++tx) {
+            if (this->tiles[this->cols * ty + tx].z0 <= nearest_z) {
+                return true;
+            }
+        }
+    }
+    return false;
+}
+
+bool OcclusionBuffer::visible(Triangle const &t) const {
+    flt nearest_z = std::max(t.c().z, std::max(t.a().z, t.b().z));
+    flt xmin      = std::min(t.a().x, std::min(t.b().x, t.c().x));
+    flt xmax      = std::max(t.a().x, std::max(t.b().x, t.c().x));
+    flt ymin      = std::min(t.a().y, std::min(t.b().y, t.c().y));
+    flt ymax      = std::max(t.a().y, std::max(t.b().y, t.c().y));
+    return this->visible(
+        clamp(xmin, 0, this->w - 1), clamp(ymin, 0, this->h - 1),
+        clamp(xmax, 0, this->w - 1), clamp(ymax, 0, this->h - 1), nearest_z);
+}
+
+// private methods
+uint64_t OcclusionBuffer::valid(size_t const &tx, size_t const &ty) const {
+    size_t   nx  = std::min<size_t>(this->w - tx * raster_block, raster_block);
+    size_t   ny  = std::min<size_t>(this->h - ty * raster_block, raster_block);
+    uint64_t row = (uint64_t{1} << nx) - 1;
+    uint64_t ret = 0;
+    for (size_t j = 0; j < ny; ++j) {
+        ret |= row << (j * raster_block);
+    }
+    return ret;
+}
+
+void OcclusionBuffer::merge(size_t const &tx, size_t const &ty,
+                            uint64_t const &m, flt const &z) {
+    Tile &t = this->tiles[this->cols * ty + tx];
+    // Pixels no nearer than the whole tile add nothing.
+    if (z <= t.z0) {
+        return;
+    }
+    t.z1 = t.mask ? std::min(t.z1, z) : z;
+    t.mask |= m;
+    if ((t.mask | ~this->valid(tx, ty)) == ~uint64_t{0}) {
+        t.z0   = t.z1;
+        t.mask = 0;
+    }
+}
+
+// Author: Blurgy <gy@blurgy.xyz>
+// Date:   Oct 17 2026, 21:30 [CST]
@@ -0,0 +1,73 @@
+#pragma once
+
+#include "Raster.hpp"
+#include "Triangle.hpp"
+#include "global.hpp"
+
+#include <cstdint>
+#include <vector>
+
+// Minimal screen-space area of an occluder, in pixels.
+flt constexpr occluder_area = 512;
+// Maximal number of occluders drawn per frame.
+size_t constexpr max_occluders = 1024;
+// Coverage of a tile is a 64-bit mask.
+static_assert(raster_block * raster_block == 64);
+
+/* Masked depth buffer for occlusion culling, after "Masked Software
+ * Occlusion Culling" (Hasselgren et al., 2016).
+ *
+ * The screen is split into tiles of `raster_block`x`raster_block` pixels.
+ * Instead of per-pixel depth values, each tile holds a coverage bitmask
+ * (one bit per pixel) and two depth values:
+ *      z0:   every pixel of the tile is at least as near as z0;
+ *      z1:   every pixel covered by `mask` is at least as near as z1.
+ * Occluders are drawn depth-only: covered pixels are merged into `mask`
+ * with their farthest depth merged into z1.  Once `mask` covers the whole
+ * tile, z1 becomes the new z0 and the working layer is emptied.  Depth
+ * values only ever become nearer where every pixel is known to be covered
+ * by an occluder, so the buffer stays conservative, at the cost of
+ * forgetting partial coverage that is not completed.
+ * */
+class OcclusionBuffer {
+  private:
+    struct Tile {
+        uint64_t mask;
+        flt      z0, z1;
+    };
+
+    // Screen size, in pixels
+    size_t h, w;
+    // Number of tile columns and rows
+    size_t cols, rows;
+    std::vector<Tile> tiles;
+
+  private:
+    // Bitmask of pixels of tile (tx, ty) that lie inside the screen.
+    uint64_t valid(size_t const &tx, size_t const &ty) const;
+    // Merge pixels `m` of tile (tx, ty), all at least as near as `z`.
+    void merge(size_t const &tx, size_t const &ty, uint64_t const &m,
+               flt const &z);
+
+  public:
+    OcclusionBuffer();
+    OcclusionBuffer(size_t const &height, size_t const &width);
+
+    // Reset all tiles to be infinitely far.
+    void clear();
+
+    // Draw an occluder set up in `r`, depth-only.
+    void draw(Raster const &r);
+
+    // Visibility checking method for an image area.  Returns false only if
+    // every tile overlapping pixels [x0, x1] x [y0, y1] (all INclusive) is
+    // nearer than `nearest_z`.
+    bool visible(size_t const &x0, size_t const &y0, size_t const &x1,
+                 size_t const &y1, flt const &nearest_z) const;
+    // Visibility checking method for a triangle, with its AABB.
+    // NOTE: `t` should have screen-space coordinates.
+    bool visible(Triangle const &t) const;
+};
+
+// Author: Blurgy <gy@blurgy.xyz>
+// Date:   Oct 17 2026, 21:30 [CST]
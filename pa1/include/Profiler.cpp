@@ -0,0 +1,152 @@
+#include "Profiler.hpp"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+
+// Node of the call tree built by `Profiler::report`.
+struct CallNode {
+    char const *          name{nullptr};
+    size_t                calls{0};
+    double                total{0}, children{0};
+    std::vector<uint32_t> kids{};
+
+    CallNode(char const *name) : name{name} {}
+};
+
+namespace {
+
+// Index of the child of `tree[parent]` named `name`, added if not found.
+uint32_t child(std::vector<CallNode> &tree, uint32_t const &parent,
+               char const *name) {
+    for (uint32_t const &k : tree[parent].kids) {
+        if (!strcmp(tree[k].name, name)) {
+            return k;
+        }
+    }
+    tree.emplace_back(name);
+    tree[parent].kids.push_back(tree.size() - 1);
+    return tree.size() - 1;
+}
+
+void print(std::vector<CallNode> const &tree, uint32_t const &id,
+           int const &indent, double const &root) {
+    CallNode const &n = tree[id];
+    msg("%*s%-*s %8zu %12.3f %12.3f %6.1f%%\n", 2 * indent, "",
+        std::max(40 - 2 * indent, 1), n.name, n.calls, n.total,
+        n.total - n.children, root > 0 ? 100 * n.total / root : 0);
+    std::vector<uint32_t> kids = n.kids;
+    std::sort(kids.begin(), kids.end(), [&](uint32_t a, uint32_t b) {
+        return tree[a].total > tree[b].total;
+    });
+    for (uint32_t const &k : kids) {
+        print(tree, k, indent + 1, root);
+    }
+}
+
+} // namespace
+
+Profiler::Profiler() { this->epoch.start(); }
+
+Profiler &Profiler::instance() {
+    static Profiler profiler;
+    return profiler;
+}
+
+ProfileThread &Profiler::local() {
+    static thread_local ProfileThread *buffer = nullptr;
+    if (buffer == nullptr) {
+        std::lock_guard<std::mutex> lock(this->registration);
+        this->threads.push_back(std::make_unique<ProfileThread>());
+        buffer      = this->threads.back().get();
+        buffer->tid = this->threads.size() - 1;
+    }
+    return *buffer;
+}
+
+double Profiler::now() const { return this->epoch.nowms(); }
+
+void Profiler::report() const {
+    // Root of the tree is a placeholder, it has all threads' outermost
+    // zones as children.
+    std::vector<CallNode> tree{CallNode{"(all)"}};
+    for (auto const &t : this->threads) {
+        // Parents come before their children when sorted by start time.
+        std::vector<ProfileEvent> events = t->events;
+        std::sort(events.begin(), events.end(),
+                  [](ProfileEvent const &a, ProfileEvent const &b) {
+                      return a.start < b.start ||
+                             (a.start == b.start && a.depth < b.depth);
+                  });
+        // Tree nodes of currently open zones, with their depths
+        std::vector<std::pair<int, uint32_t>> stack{{-1, 0}};
+        for (ProfileEvent const &e : events) {
+            while (stack.back().first >= e.depth) {
+                stack.pop_back();
+            }
+            uint32_t id = child(tree, stack.back().second, e.name);
+            double   dt = e.end - e.start;
+            tree[id].calls += 1;
+            tree[id].total += dt;
+            tree[stack.back().second].children += dt;
+            stack.emplace_back(e.depth, id);
+        }
+    }
+    double root = 0;
+    for (uint32_t const &k : tree[0].kids) {
+        root += tree[k].total;
+    }
+    msg("%-40s %8s %12s %12s %7s\n", "zone", "calls", "total (ms)",
+        "self (ms)", "share");
+    for (uint32_t const &k : tree[0].kids) {
+        print(tree, k, 0, root);
+    }
+}
+
+bool Profiler::write_trace(std::string const &path) const {
+    std::FILE *f = std::fopen(path.c_str(), "w");
+    if (f == nullptr) {
+        return false;
+    }
+    fprintf(f, "{\"displayTimeUnit\": \"ms\", \"traceEvents\": [");
+    bool first = true;
+    for (auto const &t : this->threads) {
+        fprintf(f,
+                "%s\n{\"name\": \"thread_name\", \"ph\": \"M\", \"pid\": 0, "
+                "\"tid\": %d, \"args\": {\"name\": \"thread %d\"}}",
+                first ? "" : ",", t->tid, t->tid);
+        first = false;
+        // Timestamps and durations are in microseconds
+        for (ProfileEvent const &e : t->events) {
+            fprintf(f,
+                    ",\n{\"name\": \"%s\", \"ph\": \"X\", \"pid\": 0, "
+                    "\"tid\": %d, \"ts\": %.3f, \"dur\": %.3f}",
+                    e.name, t->tid, 1e3 * e.start, 1e3 * (e.end - e.start));
+        }
+    }
+    fprintf(f, "\n]}\n");
+    return std::fclose(f) == 0;
+}
+
+void Profiler::clear() {
+    std::lock_guard<std::mutex> lock(this->registration);
+    for (auto &t : this->threads) {
+        t->events.clear();
+    }
+}
+
+ProfileZone::ProfileZone(char const *name)
+    : thread{Profiler::instance().local()}, name{name},
+      start{Profiler::instance().now()} {
+    ++this->thread.depth;
+}
+
+ProfileZone::~ProfileZone() {
+    --this->thread.depth;
+    this->thread.events.push_back(ProfileEvent{
+        this->name, this->start, Profiler::instance().now(),
+        this->thread.depth});
+}
+
+// Author: Blurgy <gy@blurgy.xyz>
+// Date:   Oct 17 2026, 20:20 [CST]
@@ -0,0 +1,102 @@
+#pragma once
+
+#include "Timer.hpp"
+#include "global.hpp"
+
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+// Zones are only recorded when `PROFILER` is defined (configure with
+// `-DPROFILER=ON`), otherwise `profm` expands to nothing.
+#ifdef PROFILER
+#define PROFILING 1
+#else
+#define PROFILING 0
+#endif
+#define _profm_concat(a, b) a##b
+#define _profm_zone(name, line)                                              \
+    ProfileZone _profm_concat(_profm_zone_, line) { name }
+// Record a zone named `name` (a string literal) from here to the end of the
+// enclosing scope.
+#if PROFILING
+#define profm(name) _profm_zone(name, __LINE__)
+#else
+#define profm(name) static_cast<void>(0)
+#endif
+
+// A finished zone.
+struct ProfileEvent {
+    // Name of the zone, a string literal
+    char const *name;
+    // Start and end time, in milliseconds since the profiler is created
+    double start, end;
+    // Number of enclosing zones in the same thread
+    int depth;
+};
+
+// Events of a single thread.  Only the owning thread appends to `events`,
+// so recording a zone takes no lock.
+struct ProfileThread {
+    // Index of the thread in the trace
+    int tid;
+    // Number of currently open zones
+    int depth{0};
+    // Finished zones, in the order they end
+    std::vector<ProfileEvent> events;
+};
+
+// Collects zones of all threads.  A thread registers its buffer on its
+// first zone, under a lock.  Reports and traces read all buffers, and must
+// not be made while any zone is open.
+class Profiler {
+  private:
+    // Started when the profiler is created, zones are timed against it
+    Timer epoch;
+    // Buffers of all threads that have recorded zones
+    std::vector<std::unique_ptr<ProfileThread>> threads;
+    std::mutex                                  registration;
+
+  private:
+    Profiler();
+
+  public:
+    // The process-wide profiler.
+    static Profiler &instance();
+
+    // Buffer of the calling thread, registered on first call.
+    ProfileThread &local();
+    // Time since the profiler is created, in milliseconds.
+    double now() const;
+
+    // Print a call tree of all recorded zones, merging zones with the same
+    // name under the same parent (across threads), with their call counts,
+    // total time and self time (excluding child zones).
+    void report() const;
+    // Write all recorded zones as a Chrome `trace_event` json file, which
+    // can be opened with chrome://tracing or https://ui.perfetto.dev.  Each
+    // thread is shown as a separate track.
+    // @return: Whether the file is written successfully
+    bool write_trace(std::string const &path) const;
+    // Drop all recorded zones.
+    void clear();
+};
+
+// RAII zone, records an event from construction to destruction.
+class ProfileZone {
+  private:
+    ProfileThread &thread;
+    char const *   name;
+    double         start;
+
+  public:
+    ProfileZone(char const *name);
+    ~ProfileZone();
+
+    ProfileZone(ProfileZone const &) = delete;
+    ProfileZone &operator=(ProfileZone const &) = delete;
+};
+
+// Author: Blurgy <gy@blurgy.xyz>
+// Date:   Oct 17 2026, 20:20 [CST]
@@ -1,178 +1,263 @@
 #include "Pyramid.hpp"
 
+#include <bit>
 #include <cassert>
 
-Pyramid::Pyramid() {}
+Pyramid::Pyramid() : dmin{0}, dscale{1} {}
 Pyramid::Pyramid(size_t const &height, size_t const &width)
-    : h{height}, w{width} {
-    this->nodes.resize(this->h * this->w, nullptr);
+    : h{height}, w{width}, dmin{0}, dscale{1} {
     this->construct();
 }
 
-flt &Pyramid::operator()(size_t const &x, size_t const &y) {
-    return this->nodes[this->w * y + x]->depth;
+depth_t &Pyramid::operator()(size_t const &x, size_t const &y) {
+    return this->levels[0][this->w * y + x];
 }
-flt const &Pyramid::operator()(size_t const &x, size_t const &y) const {
-    return this->nodes[this->w * y + x]->depth;
+depth_t const &Pyramid::operator()(size_t const &x, size_t const &y) const {
+    return this->levels[0][this->w * y + x];
 }
 
 void Pyramid::construct() {
-    pss southwestern = std::make_pair(0, 0);
-    pss northeastern = std::make_pair(this->w, this->h);
     debugm("Constructing depth buffer MIP-map ..\n");
-    this->root = build(southwestern, northeastern, nullptr);
-    this->update_tdep(this->root);
+    this->ws.clear();
+    this->hs.clear();
+    this->levels.clear();
+    this->stamps.clear();
+    size_t lw = this->w, lh = this->h;
+    while (true) {
+        this->ws.push_back(lw);
+        this->hs.push_back(lh);
+        this->levels.emplace_back(lw * lh, farthest);
+        if (lw <= 1 && lh <= 1) {
+            break;
+        }
+        lw = (lw + 1) >> 1;
+        lh = (lh + 1) >> 1;
+    }
+    this->frame  = 0;
+    this->elevel = std::min(epoch_level, this->nlevels() - 1);
+    for (int l = 0; l < this->nlevels(); ++l) {
+        this->stamps.emplace_back(
+            l < this->elevel ? 0 : this->ws[l] * this->hs[l], this->frame);
+    }
+    this->nears.assign(this->ws[this->elevel] * this->hs[this->elevel],
+                       farthest);
     msg("Hierarchical depth buffer constructed\n");
 }
 
-void Pyramid::clear(Node4 *node) {
-    if (nullptr == node) {
+void Pyramid::clear() {
+    if (++this->frame != 0) {
         return;
     }
-    node->depth = -std::numeric_limits<flt>::max();
-    for (Node4 *child : node->children) {
-        this->clear(child);
+    // Frame counter wrapped around, actually clear all levels.
+    for (auto &level : this->levels) {
+        std::fill(level.begin(), level.end(), farthest);
     }
+    for (auto &stamp : this->stamps) {
+        std::fill(stamp.begin(), stamp.end(), this->frame);
+    }
+    std::fill(this->nears.begin(), this->nears.end(), farthest);
 }
 
-void Pyramid::setz(size_t const &x, size_t const &y, flt const &zval) {
-    (*this)(x, y) = zval;
-    // debugm("finding node with (%zu, %zu)\n", x, y);
-    Node4 *node = this->which(x, y, this->root);
-    // debugm("found node with (%zu, %zu)\n", x, y);
-    assert(node != nullptr);
-    node->depth = zval;
-    while (node != this->root) {
-        // node->fa->depth = std::min(node->fa->depth, node->depth);
-        node = node->fa;
-        this->pushup(node);
-    }
-}
-
-bool Pyramid::visible(Triangle const &t) {
-    // NOTE: t has screenspace coordinates.
-    flt    nearest_z = std::max(t.c().z, std::max(t.a().z, t.b().z));
-    Node4 *a         = this->which(t.a().x, t.a().y, this->root);
-    Node4 *b         = this->which(t.b().x, t.b().y, this->root);
-    Node4 *c         = this->which(t.c().x, t.c().y, this->root);
-    Node4 *anc       = this->lca(a, this->lca(b, c));
-    if (nearest_z < anc->depth) {
-        // Invisible if the entire image's farthest depth value is closer than
-        // the triangle's nearest depth value.
+void Pyramid::set_range(flt const &zmin, flt const &zmax) {
+    this->dmin   = zmin;
+    this->dscale = zmax > zmin ? 1 / (zmax - zmin) : 1;
+}
+
+depth_t Pyramid::encode(flt const &z) const {
+#ifdef ZBUF_FIXED_DEPTH
+    flt code = (z - this->dmin) * this->dscale * ((1 << depth_bits) - 1);
+    return static_cast<depth_t>(
+        clamp(std::round(code), 0, (1 << depth_bits) - 1));
+#else
+    return z;
+#endif
+}
+
+depth_t Pyramid::encode_near(flt const &z) const {
+#ifdef ZBUF_FIXED_DEPTH
+    flt code = (z - this->dmin) * this->dscale * ((1 << depth_bits) - 1);
+    return static_cast<depth_t>(
+        clamp(std::ceil(code), 0, (1 << depth_bits) - 1));
+#else
+    return z;
+#endif
+}
+
+depth_t Pyramid::encode_far(flt const &z) const {
+#ifdef ZBUF_FIXED_DEPTH
+    flt code = (z - this->dmin) * this->dscale * ((1 << depth_bits) - 1);
+    return static_cast<depth_t>(
+        clamp(std::floor(code), 0, (1 << depth_bits) - 1));
+#else
+    return z;
+#endif
+}
+
+int const &Pyramid::epoch_tile_level() const { return this->elevel; }
+
+bool Pyramid::stale(size_t const &x, size_t const &y) const {
+    int const &el = this->elevel;
+    return this->stamps[el][this->ws[el] * (y >> el) + (x >> el)] !=
+           this->frame;
+}
+
+bool Pyramid::touch(size_t const &x, size_t const &y) {
+    int const &el    = this->elevel;
+    size_t     tx    = x >> el, ty = y >> el;
+    uint32_t & stamp = this->stamps[el][this->ws[el] * ty + tx];
+    if (stamp == this->frame) {
         return false;
     }
+    // Clear all texels below (and including) the epoch tile.
+    for (int l = 0; l <= el; ++l) {
+        size_t n  = size_t{1} << (el - l);
+        size_t x0 = tx << (el - l), x1 = std::min(x0 + n, this->ws[l]);
+        size_t y0 = ty << (el - l), y1 = std::min(y0 + n, this->hs[l]);
+        for (size_t j = y0; j < y1; ++j) {
+            std::fill(this->levels[l].begin() + this->ws[l] * j + x0,
+                      this->levels[l].begin() + this->ws[l] * j + x1,
+                      farthest);
+        }
+    }
+    this->nears[this->ws[el] * ty + tx] = farthest;
+    stamp                               = this->frame;
     return true;
 }
 
-bool Pyramid::visible(Triangle const &t, Node4 *node) const {
-    if (node == nullptr) {
-        node = this->root;
+int Pyramid::nlevels() const { return this->levels.size(); }
+size_t const &Pyramid::width(int const &l) const { return this->ws[l]; }
+size_t const &Pyramid::height(int const &l) const { return this->hs[l]; }
+depth_t Pyramid::at(int const &l, size_t const &x, size_t const &y) const {
+    // Level and coordinate of the texel carrying the stamp
+    int sl = std::max(l, this->elevel), s = sl - l;
+    if (this->stamps[sl][this->ws[sl] * (y >> s) + (x >> s)] != this->frame) {
+        return farthest;
     }
-    flt nearest_z = std::max(t.c().z, std::max(t.a().z, t.b().z));
-    if (nearest_z < node->depth) {
-        // If triangle `t` has no vertex nearer than current node's nearest z
-        // value, it is not visible.
-        return false;
+    return this->levels[l][this->ws[l] * y + x];
+}
+depth_t Pyramid::nearest(size_t const &x, size_t const &y) const {
+    int const &el = this->elevel;
+    size_t     i  = this->ws[el] * (y >> el) + (x >> el);
+    return this->stamps[el][i] == this->frame ? this->nears[i] : farthest;
+}
+
+int Pyramid::setz(size_t const &x, size_t const &y, depth_t const &zval,
+                  int const &top) {
+    (*this)(x, y) = zval;
+    // Depth values only get nearer, and the pixel's epoch tile has been
+    // touched in current frame.
+    int const &el = this->elevel;
+    depth_t &  nz = this->nears[this->ws[el] * (y >> el) + (x >> el)];
+    nz            = std::max(nz, zval);
+    int last      = top < 0 ? this->nlevels() - 1 : top;
+    for (int l = 1; l <= last; ++l) {
+        if (!this->pushup(l, x >> l, y >> l)) {
+            return l - 1;
+        }
     }
-    // If triangle `t` has some vertex nearer than current nodes' nearest z
-    // value ..
-    if (node->isleaf) {
-        // If this node cannot be further devided (is a leaf node), the
-        // triangle is visible.
-        return true;
+    return std::max(last, 0);
+}
+
+int Pyramid::update(size_t x0, size_t y0, size_t x1, size_t y1,
+                    int const &top) {
+    int const &el = this->elevel;
+    for (size_t y = y0; y < y1; ++y) {
+        for (size_t x = x0; x < x1; ++x) {
+            depth_t &nz = this->nears[this->ws[el] * (y >> el) + (x >> el)];
+            nz          = std::max(nz, (*this)(x, y));
+        }
     }
-    // One of the vertices of traingle `t` falls in this child's quadrant.
-    Node4 *child = node->children[node->idof(t.a().x, t.a().y)];
-    if (node->children[node->idof(t.b().x, t.b().y)] != child ||
-        node->children[node->idof(t.c().x, t.c().y)] != child) {
-        // If not all vertices of triangle `t` falls in the same quadrant,
-        // i.e. if triangle `t` covers more than one quadrant of current node,
-        // treat `t` as visible and do normal rendering.
-        return true;
+    int last  = top < 0 ? this->nlevels() - 1 : top;
+    int steps = 0;
+    for (int l = 1; l <= last; ++l) {
+        // Texels of level `l` covering the area, [x0, x1) x [y0, y1)
+        x0 >>= 1, y0 >>= 1;
+        x1 = ((x1 - 1) >> 1) + 1, y1 = ((y1 - 1) >> 1) + 1;
+        bool changed = false;
+        for (size_t y = y0; y < y1; ++y) {
+            for (size_t x = x0; x < x1; ++x) {
+                if (this->pushup(l, x, y)) {
+                    changed = true;
+                    ++steps;
+                }
+            }
+        }
+        if (!changed) {
+            break;
+        }
     }
-    // If all 3 vertices of triangle `t` falls into the same quadrant, dive
-    // into that quadrant and do further checking.
-    return this->visible(t, child);
+    return steps;
 }
 
-// private methods
-void Pyramid::pushup(Node4 *node) const {
-    flt ndepth = std::numeric_limits<flt>::max();
-    for (auto &child : node->children) {
-        if (nullptr == child) {
-            continue;
+void Pyramid::refresh(int const &l) {
+    for (int k = l + 1; k < this->nlevels(); ++k) {
+        for (size_t y = 0; y < this->hs[k]; ++y) {
+            for (size_t x = 0; x < this->ws[k]; ++x) {
+                this->pushup(k, x, y);
+            }
         }
-        ndepth = std::min(ndepth, child->depth);
     }
-    node->depth = ndepth;
 }
 
-void Pyramid::update_tdep(Node4 *node) const {
-    for (auto &child : node->children) {
-        if (nullptr == child) {
-            continue;
-        }
-        child->tdep = node->tdep + 1;
-        update_tdep(child);
+bool Pyramid::visible(Triangle const &t, size_t x0, size_t y0, size_t x1,
+                      size_t y1, int *level) const {
+    flt nearest_z = std::max(t.c().z, std::max(t.a().z, t.b().z));
+    // Clamp the triangle's AABB to given area.
+    x1 = std::min(x1, this->w), y1 = std::min(y1, this->h);
+    flt xmin = std::min(t.a().x, std::min(t.b().x, t.c().x));
+    flt xmax = std::max(t.a().x, std::max(t.b().x, t.c().x));
+    flt ymin = std::min(t.a().y, std::min(t.b().y, t.c().y));
+    flt ymax = std::max(t.a().y, std::max(t.b().y, t.c().y));
+    size_t xa = clamp(xmin, x0, x1 - 1), xb = clamp(xmax, x0, x1 - 1);
+    size_t ya = clamp(ymin, y0, y1 - 1), yb = clamp(ymax, y0, y1 - 1);
+    return this->visible(xa, ya, xb, yb, nearest_z, level);
+}
+
+bool Pyramid::visible(size_t const &x0, size_t const &y0, size_t const &x1,
+                      size_t const &y1, flt const &nearest_z,
+                      int *level) const {
+    // Lowest level where corners of the area fall into the same texel.
+    int l = std::bit_width((x0 ^ x1) | (y0 ^ y1));
+    if (level != nullptr) {
+        *level = l;
+    }
+    // Invisible if the texel's farthest depth value is closer than the
+    // nearest depth value.
+    return this->encode_near(nearest_z) >= this->at(l, x0 >> l, y0 >> l);
+}
+
+bool Pyramid::nearer(size_t const &x0, size_t const &y0, size_t const &x1,
+                     size_t const &y1, flt const &farthest_z) const {
+    int const &el = this->elevel;
+    if ((x0 >> el) != (x1 >> el) || (y0 >> el) != (y1 >> el)) {
+        return false;
     }
+    return this->encode_far(farthest_z) > this->nearest(x0, y0);
 }
 
-Node4 *const Pyramid::lca(Node4 *a, Node4 *b) const {
-    Node4 *anca = a, *ancb = b;
-    while (anca != ancb) {
-        if (anca->tdep > ancb->tdep) {
-            anca = anca->fa;
-        } else {
-            ancb = ancb->fa;
+// private methods
+bool Pyramid::pushup(int const &l, size_t const &x, size_t const &y) {
+    size_t const &bw = this->ws[l - 1];
+    size_t const &bh = this->hs[l - 1];
+    size_t        cx = x << 1, cy = y << 1;
+    depth_t       ndepth = this->at(l - 1, cx, cy);
+    if (cx + 1 < bw) {
+        ndepth = std::min(ndepth, this->at(l - 1, cx + 1, cy));
+    }
+    if (cy + 1 < bh) {
+        ndepth = std::min(ndepth, this->at(l - 1, cx, cy + 1));
+        if (cx + 1 < bw) {
+            ndepth = std::min(ndepth, this->at(l - 1, cx + 1, cy + 1));
         }
     }
-    return anca;
-}
-
-Node4 *Pyramid::which(int x, int y, Node4 *node) const {
-    x = clamp(x, 0, this->w - 1);
-    y = clamp(y, 0, this->h - 1);
-    return this->nodes[y * this->w + x];
-}
-
-Node4 *const Pyramid::build(pss const &sw, pss const &ne, Node4 *const fa) {
-    int x1 = sw.first, y1 = sw.second;
-    int x2 = ne.first, y2 = ne.second;
-    if (x1 >= x2 || y1 >= y2) {
-        // Can't divide in either of x or y dimention.
-        return nullptr;
-    }
-    Node4 *ret = new Node4;
-    ret->fa    = fa;
-    ret->sw    = sw;
-    ret->ne    = ne;
-    ret->depth = -std::numeric_limits<flt>::max();
-    if (x1 + 1 == x2 && y1 + 1 == y2) {
-        // Leaf node, assign actual depth value to the node and return.
-        ret->isleaf                    = true;
-        ret->split                     = sw;
-        this->nodes[y1 * this->w + x1] = ret;
-        return ret;
-    }
-    int midx   = (x1 + x2) >> 1;
-    int midy   = (y1 + y2) >> 1;
-    ret->split = std::make_pair(midx, midy);
-    // Note: `ne` has EXclusive coordinate.
-    pss mid   = std::make_pair(midx, midy);
-    pss mid_s = std::make_pair(midx, y1); // Southern mid point
-    pss mid_w = std::make_pair(x1, midy); // Western mid point
-    pss mid_n = std::make_pair(midx, y2); // Northern mid point
-    pss mid_e = std::make_pair(x2, midy); // Eastern mid point
-    // Southwestern child
-    ret->children[0] = build(sw, mid, ret);
-    // Southeastern child
-    ret->children[1] = build(mid_s, mid_e, ret);
-    // Northweastern child
-    ret->children[2] = build(mid_w, mid_n, ret);
-    // Northeastern child
-    ret->children[3] = build(mid, ne, ret);
-    pushup(ret);
-    return ret;
+    if (this->at(l, x, y) == ndepth) {
+        return false;
+    }
+    this->levels[l][this->ws[l] * y + x] = ndepth;
+    if (l >= this->elevel) {
+        this->stamps[l][this->ws[l] * y + x] = this->frame;
+    }
+    return true;
 }
 
 // Author: Blurgy <gy@blurgy.xyz>
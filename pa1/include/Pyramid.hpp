@@ -4,74 +4,91 @@
 #include "global.hpp"
 
 #include <array>
+#include <cstdint>
 #include <vector>
 
-struct Node4 : Node<4> {
-    Node4()
-        : fa{nullptr}, depth{-std::numeric_limits<flt>::max()},
-          children{nullptr} {}
-
-    // Returns which quadrant of current node that coordinate (x, y) is in
-    int idof(size_t const &x, size_t const &y) {
-        if (this->isleaf) {
-            return -1;
-        }
-        return 2 * (y > this->split.second) + (x > this->split.first);
-    }
-
-    // Father of this node
-    Node4 *fa;
-
-    // Southwestern and Northeastern corners
-    pss sw, ne;
-    // Splitting point
-    pss split;
-    // Depth (z) value
-    flt depth;
-
-    /* Node's children has following orders:
-     *                  |-------|
-     *                  | 2 | 3 |
-     *                  |-------|
-     *                  | 0 | 1 |
-     *                  o-------|
-     *                  ^
-     *                  origin
-     *
-     * Caveat: some of the children might be nullptr, because input buffer is
-     *         not always a square, causing one dimentions be divided up
-     *         earlier than the other.
-     * */
-    std::array<Node4 *, 4> children;
-};
-
+// Depth values stored in `Pyramid`, nearer is larger.  By default they are
+// the depth values computed by the rasterizer.  With `ZBUF_FIXED_DEPTH`,
+// they are 24-bit fixed-point numbers with a reversed-Z mapping: the near
+// plane maps to the largest code and infinitely far to 0, see
+// `Pyramid::encode`.
+#ifdef ZBUF_FIXED_DEPTH
+typedef uint32_t depth_t;
+#else
+typedef flt depth_t;
+#endif
+
+/* Depth MIP-map, each level is stored as a contiguous row-major array.
+ *
+ * Level 0 has the image's resolution, every texel of level `l + 1` covers
+ * (at most) 2x2 texels of level `l`:
+ *                  |-------|
+ *                  | 2 | 3 |
+ *                  |-------|    level l
+ *                  | 0 | 1 |
+ *                  o-------|
+ *                      |
+ *                      v
+ *                    |---|      level l + 1
+ *                    |   |
+ *                    o---|
+ * so that the parent of texel (x, y) is texel (x >> 1, y >> 1), and texel
+ * (x, y) of level `l` covers pixels [x << l, (x + 1) << l) x [y << l,
+ * (y + 1) << l) of the image.  The topmost level has exactly 1 texel.  Each
+ * texel holds the farthest (smallest) depth value of the pixels it covers.
+ * Depth values are stored as `depth_t`, rasterizers convert their depth
+ * values with `encode` before testing and writing them.
+ *
+ * Farthest values can only reject areas.  To also accept areas that are in
+ * front of everything drawn so far, each texel of `epoch_level` (epoch
+ * tile) holds the nearest (largest) depth value of the pixels it covers.
+ * Since depth values only get nearer within a frame, it is raised as
+ * pixels are written, at the cost of a single small array.
+ *
+ * Clearing is done with frame epochs: texels of level `epoch_level` and
+ * above carry the frame (epoch) they were last written in, texels below
+ * `epoch_level` share the stamp of their ancestor at `epoch_level`.  Texels
+ * with stale stamps are treated as cleared, and are actually cleared the
+ * first time they are touched in current frame.
+ * */
 class Pyramid {
   private:
     // Screen size, in pixels
     size_t h, w;
 
-    // Leaf nodes, containing finest depth values
-    std::vector<Node4 *> nodes;
+    // Width and height of each level
+    std::vector<size_t> ws, hs;
+    // Depth values of each level
+    std::vector<std::vector<depth_t>> levels;
+    // Mapping of depth values to fixed-point codes, see `set_range`
+    flt dmin, dscale;
+
+    // Current frame (epoch)
+    uint32_t frame;
+    // Level of epoch tiles, i.e. `epoch_level`, or the topmost level when
+    // the image is too small
+    int elevel;
+    // Frame stamps of each level, empty for levels below `elevel`
+    std::vector<std::vector<uint32_t>> stamps;
+    // Nearest depth values of epoch tiles
+    std::vector<depth_t> nears;
 
   private:
-    // Helper functions
-    void pushup(Node4 *node) const;
-    // Recursively update all tree nodes' `tdep` value.
-    void update_tdep(Node4 *node) const;
-    // Build pyramid recursively, root node has index 0.
-    // @param     sw: Southwestern coordinate (INclusive) of this node's area.
-    // @param     ne: Northeastern coordinate (EXclusive) of this node's area.
-    Node4 *const build(pss const &sw, pss const &ne,
-                       Node4 *const fa = nullptr);
-    // Lowest common ancestor of two nodes
-    Node4 *const lca(Node4 *a, Node4 *b) const;
-    // Leaf node corresponding to image coordinate (x, y), pass this->root to
-    // the 3rd parameter.
-    Node4 *which(int x, int y, Node4 *node) const;
+    // Recompute depth value of texel (x, y) at level `l` (l > 0) from its
+    // children, returns whether the value has changed.
+    bool pushup(int const &l, size_t const &x, size_t const &y);
 
   public:
-    // Root of depth MIP-map
-    Node4 *root;
+    // Epoch tiles are texels of this level, i.e. squares of 8x8 pixels.
+    static int constexpr epoch_level = 3;
+#ifdef ZBUF_FIXED_DEPTH
+    // Bits of fixed-point depth values
+    static int constexpr depth_bits = 24;
+    // Stored depth value of cleared (infinitely far) pixels
+    static depth_t constexpr farthest = 0;
+#else
+    static depth_t constexpr farthest = -std::numeric_limits<flt>::max();
+#endif
 
   public:
     Pyramid();
@@ -80,26 +97,93 @@ class Pyramid {
     // Frontend for MIP-map construction.
     void construct();
 
-    // Clear depths recursively for `node` and all of its descendants.
-    void clear(Node4 *node);
+    // Clear depths of all levels, by starting a new frame (epoch).
+    void clear();
+
+    // Set the range of depth values [zmin, zmax] that fixed-point codes are
+    // spread over, values outside of it are clamped.  No effect unless
+    // compiled with `ZBUF_FIXED_DEPTH`.
+    void set_range(flt const &zmin, flt const &zmax);
+    // Stored depth value of depth `z`, rounded to the nearest code.
+    depth_t encode(flt const &z) const;
+    // Stored depth value of depth `z`, rounded towards the near plane, so
+    // that visibility tests stay conservative.
+    depth_t encode_near(flt const &z) const;
+    // Stored depth value of depth `z`, rounded away from the near plane,
+    // for conservative acceptance tests.
+    depth_t encode_far(flt const &z) const;
+
+    // Level of epoch tiles.
+    int const &epoch_tile_level() const;
+    // Returns whether the epoch tile containing pixel (x, y) has not been
+    // touched in current frame.
+    bool stale(size_t const &x, size_t const &y) const;
+    // Make sure the epoch tile containing pixel (x, y) is cleared for
+    // current frame, returns whether it was stale (and is cleared now).
+    // NOTE: Pixels have to be touched before their depth values are read or
+    //       written through `operator()` or `setz`.
+    bool touch(size_t const &x, size_t const &y);
+
+    // Number of levels.
+    int nlevels() const;
+    // Width of level `l`, in texels.
+    size_t const &width(int const &l) const;
+    // Height of level `l`, in texels.
+    size_t const &height(int const &l) const;
+    // Depth value of texel (x, y) at level `l`, texels in stale epoch tiles
+    // are infinitely far.
+    depth_t at(int const &l, size_t const &x, size_t const &y) const;
+    // Nearest depth value of the epoch tile containing pixel (x, y).
+    depth_t nearest(size_t const &x, size_t const &y) const;
 
     // Set depth value at given image coordinate (x, y), and update the
-    // pyramid.
-    void setz(size_t const &x, size_t const &y, flt const &zval);
-
-    // Bottom-up visibility checking method.  Computes the least common
-    // ancestor node of the 3 vertices of triangle `t`, then check if `t` is
-    // visible in that node.
-    bool visible(Triangle const &t);
-    // Top-down visibility checking method.  Check whether or not the triangle
-    // `t` is visible in the root node, if not, dive into its children to do
-    // further checking.
-    bool visible(Triangle const &t, Node4 *node = nullptr) const;
+    // pyramid.  Propagation stops as soon as a level's value does not
+    // change, or after level `top` (the topmost level if negative) is
+    // updated, so that threads owning disjoint texels of level `top` never
+    // write to the same texel.
+    // @return: Number of texels updated above level 0
+    int setz(size_t const &x, size_t const &y, depth_t const &zval,
+             int const &top = -1);
+    // Update the pyramid after depth values of pixels [x0, x1) x [y0, y1)
+    // are written through `operator()`, in the same way as `setz`.  Cheaper
+    // than calling `setz` on each pixel when the area covers whole texels.
+    // @return: Number of texels updated above level 0
+    int update(size_t x0, size_t y0, size_t x1, size_t y1,
+               int const &top = -1);
+
+    // Recompute depth values of all levels above level `l` from level `l`.
+    // Nearest values of epoch tiles are not recomputed, pixels written
+    // without `setz` or `update` must not be tested with `nearer`.
+    void refresh(int const &l);
+
+    // Visibility checking method for an image area.  Finds the lowest level
+    // where a single texel covers pixels [x0, x1] x [y0, y1] (all
+    // INclusive), then check if anything as near as `nearest_z` in the area
+    // is visible in that texel.
+    // @param level: Receives the level of the tested texel if not null
+    bool visible(size_t const &x0, size_t const &y0, size_t const &x1,
+                 size_t const &y1, flt const &nearest_z,
+                 int *level = nullptr) const;
+    // Visibility checking method.  Finds the lowest level where a single
+    // texel covers the triangle's AABB (clamped to image area [x0, x1) x [y0,
+    // y1)), then check if `t` is visible in that texel.
+    // NOTE: `t` should have screen-space coordinates.
+    bool visible(Triangle const &t, size_t x0 = 0, size_t y0 = 0,
+                 size_t x1 = std::numeric_limits<size_t>::max(),
+                 size_t y1 = std::numeric_limits<size_t>::max(),
+                 int *level = nullptr) const;
+    // Trivial acceptance for an image area [x0, x1] x [y0, y1] (all
+    // INclusive) inside a single epoch tile.  Checks if anything as far as
+    // `farthest_z` in the area is nearer than all depth values of the tile,
+    // i.e. passes depth tests of all pixels in the area.  Areas spanning
+    // several epoch tiles are never accepted.
+    bool nearer(size_t const &x0, size_t const &y0, size_t const &x1,
+                size_t const &y1, flt const &farthest_z) const;
 
     // Get depth value's reference at image coordinate (x, y)
-    flt &operator()(size_t const &x, size_t const &y);
+    depth_t &operator()(size_t const &x, size_t const &y);
     // Get depth value's const reference at image coordinate (x, y)
-    flt const &operator()(size_t const &x, size_t const &y) const;
+    depth_t const &operator()(size_t const &x, size_t const &y) const;
 };
 
 // Author: Blurgy <gy@blurgy.xyz>
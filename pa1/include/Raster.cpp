@@ -0,0 +1,103 @@
+#include "Raster.hpp"
+
+#include <algorithm>
+#include <cmath>
+
+Raster::Raster(Triangle const &t, Triangle const &v) {
+    int64_t constexpr s = subpixels;
+    // Snapped vertex coordinates
+    std::array<int64_t, 3> px, py;
+    for (int i = 0; i < 3; ++i) {
+        px[i] = std::llround(t.v[i].x * s);
+        py[i] = std::llround(t.v[i].y * s);
+    }
+    // Floor and ceiling of the AABB, in pixels
+    auto floordiv = [](int64_t const &n) {
+        return n >= 0 ? n / s : -((s - 1 - n) / s);
+    };
+    this->xmin = floordiv(std::min({px[0], px[1], px[2]}));
+    this->ymin = floordiv(std::min({py[0], py[1], py[2]}));
+    this->xmax = -floordiv(-std::max({px[0], px[1], px[2]}));
+    this->ymax = -floordiv(-std::max({py[0], py[1], py[2]}));
+    // Origin of the equations is the center of pixel (xmin, ymin).
+    for (int i = 0; i < 3; ++i) {
+        px[i] -= this->xmin * s + s / 2;
+        py[i] -= this->ymin * s + s / 2;
+    }
+    int64_t doublearea = 0;
+    for (int i = 0; i < 3; ++i) {
+        int p = (i + 1) % 3, q = (i + 2) % 3;
+        this->a[i] = py[p] - py[q];
+        this->b[i] = px[q] - px[p];
+        this->c[i] = px[p] * py[q] - px[q] * py[p];
+        doublearea += this->c[i];
+    }
+    if (doublearea < 0) {
+        // Flip edges of clockwise triangles so that insides are positive.
+        for (int i = 0; i < 3; ++i) {
+            this->a[i] = -this->a[i];
+            this->b[i] = -this->b[i];
+            this->c[i] = -this->c[i];
+        }
+        doublearea = -doublearea;
+    }
+    this->inv_doublearea = doublearea > 0 ? flt{1} / doublearea : 0;
+    // Coefficients of the depth plane are per pixel, relative to the
+    // corner of the AABB.
+    this->za = this->zb = this->zc = 0;
+    for (int i = 0; i < 3; ++i) {
+        flt iz = this->inv_doublearea / v.v[i].z;
+        this->za += this->a[i] * s * iz;
+        this->zb += this->b[i] * s * iz;
+        this->zc += (this->c[i] - (this->a[i] + this->b[i]) * s / 2) * iz;
+    }
+    for (int i = 0; i < 3; ++i) {
+        // Top-left rule, see `Raster`
+        bool owned = this->a[i] > 0 || (this->a[i] == 0 && this->b[i] > 0);
+        this->c[i] += owned;
+        // Steps per pixel
+        this->a[i] *= s;
+        this->b[i] *= s;
+    }
+}
+
+bool Raster::degenerate() const { return this->inv_doublearea == 0; }
+
+flt Raster::area() const {
+    return flt{.5} / this->inv_doublearea / (subpixels * subpixels);
+}
+
+int64_t Raster::edge(int const &i, int const &x, int const &y) const {
+    return this->a[i] * (x - this->xmin) + this->b[i] * (y - this->ymin) +
+           this->c[i];
+}
+
+flt Raster::iz(flt const &x, flt const &y) const {
+    return this->za * (x - this->xmin) + this->zb * (y - this->ymin) +
+           this->zc;
+}
+
+coverage Raster::classify(int const &x0, int const &y0, int const &x1,
+                          int const &y1) const {
+    // Outermost pixels of the block
+    int  left = x0, right = x1 - 1;
+    int  bottom = y0, top = y1 - 1;
+    bool all_inside{true};
+    for (int i = 0; i < 3; ++i) {
+        // Corners where the edge equation reaches its max and min values
+        int64_t emax = this->edge(i, this->a[i] > 0 ? right : left,
+                                  this->b[i] > 0 ? top : bottom);
+        int64_t emin = this->edge(i, this->a[i] > 0 ? left : right,
+                                  this->b[i] > 0 ? bottom : top);
+        if (emax <= 0) {
+            return coverage::outside;
+        }
+        if (emin <= 0) {
+            all_inside = false;
+        }
+    }
+    return all_inside ? coverage::inside : coverage::partial;
+}
+
+// Author: Blurgy <gy@blurgy.xyz>
+// Date:   Oct 17 2026, 10:12 [CST]
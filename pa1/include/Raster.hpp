@@ -0,0 +1,75 @@
+#pragma once
+
+#include "Triangle.hpp"
+#include "global.hpp"
+
+#include <array>
+#include <cstdint>
+
+// Side length of a raster block, in pixels.
+int constexpr raster_block = 8;
+// Vertices are snapped to 1/`subpixels` of a pixel before setup.
+int64_t constexpr subpixels = 256;
+
+// Coverage of a rectangular pixel block by a triangle.
+enum coverage {
+    outside, // no pixel center in the block is covered
+    partial, // some pixel centers might be covered
+    inside,  // all pixel centers in the block are covered
+};
+
+// Triangle setup stage.  Edge equations and the perspective-correct depth
+// plane of a screen-space triangle are computed once, then evaluated
+// incrementally across pixels:
+//      e_i(x, y) = a[i] * (x - xmin) + b[i] * (y - ymin) + c[i],
+// at the center of pixel (x, y).  Edge `i` is the one opposite to vertex
+// `i`, e_i is positive inside the triangle regardless of the triangle's
+// winding order, and e_i / doublearea is the barycentric coordinate of
+// vertex `i`.
+//
+// Vertices are snapped to a grid of 1/`subpixels` pixel, and equations are
+// evaluated in fixed point, relative to the corner of the triangle's AABB,
+// so that edge values are exact however they are computed: evaluated at a
+// pixel, or stepped there from another pixel.  Pixel centers lying exactly
+// on an edge are decided by the top-left rule (in image coordinates, whose
+// y axis points down, i.e. left and bottom edges here): such pixels belong
+// to the triangle only if the edge is a left edge, or a horizontal edge
+// with the triangle above it.  Every edge value is biased by one unit
+// accordingly, so that `e_i > 0` is the whole coverage test.  An edge
+// shared by two triangles is left for one and right for the other, so the
+// shared pixel centers are covered exactly once.
+struct Raster {
+    Raster(Triangle const &t, Triangle const &v);
+
+    // Returns whether the triangle covers no pixel at all.
+    bool degenerate() const;
+
+    // Area of the triangle, in pixels.
+    flt area() const;
+
+    // Value of edge equation `i` at the center of pixel (x, y).
+    int64_t edge(int const &i, int const &x, int const &y) const;
+    // Reciprocal of view-space depth at screen coordinate (x, y).
+    flt iz(flt const &x, flt const &y) const;
+
+    // Classify pixel block [x0, x1) x [y0, y1) against all three edges,
+    // by evaluating edge equations at the block's corner pixels.
+    coverage classify(int const &x0, int const &y0, int const &x1,
+                      int const &y1) const;
+
+  public:
+    // Coefficients of edge equations, in units of 1/`subpixels`^2 of a
+    // pixel.  a[i] and b[i] are the increments per pixel.
+    std::array<int64_t, 3> a, b, c;
+    // Coefficients of the reciprocal depth plane:
+    //      1 / z(x, y) = za * (x - xmin) + zb * (y - ymin) + zc
+    flt za, zb, zc;
+    // Reciprocal of the triangle's doubled area, in units of edge values
+    flt inv_doublearea;
+    // AABB in pixel coordinates, min values are INclusive and max values are
+    // EXclusive
+    int xmin, xmax, ymin, ymax;
+};
+
+// Author: Blurgy <gy@blurgy.xyz>
+// Date:   Oct 17 2026, 10:12 [CST]
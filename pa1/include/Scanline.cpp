@@ -0,0 +1,50 @@
+#include "Scanline.hpp"
+
+// Floor of n / d, for d > 0.
+static int64_t floordiv(int64_t const &n, int64_t const &d) {
+    return n >= 0 ? n / d : -((d - 1 - n) / d);
+}
+
+ActiveTriangle::ActiveTriangle(uint32_t const &id, Triangle const &t,
+                               Triangle const &v, int const &row)
+    : id{id}, r{t, v}, y{row} {
+    for (int i = 0; i < 3; ++i) {
+        this->e[i] = this->r.edge(i, this->r.xmin, row);
+    }
+}
+
+void ActiveTriangle::span(int const &xlo, int const &xhi, int &x0,
+                          int &x1) const {
+    // Covered pixels i satisfy e_i = e[k] + a[k] * (i - xmin) > 0 for all
+    // edges k, so each edge bounds the span from the left or from the
+    // right, and the bounds are exact.
+    int64_t left  = std::numeric_limits<int64_t>::min();
+    int64_t right = std::numeric_limits<int64_t>::max();
+    for (int k = 0; k < 3; ++k) {
+        int64_t const &a = this->r.a[k];
+        if (a > 0) {
+            // Inside where i - xmin > -e / a
+            left = std::max(left, floordiv(-this->e[k], a) + 1);
+        } else if (a < 0) {
+            // Inside where i - xmin < e / -a
+            right = std::min(right, -floordiv(-this->e[k], -a));
+        } else if (this->e[k] <= 0) {
+            // Horizontal edge, whole scanline is outside
+            x0 = x1 = xlo;
+            return;
+        }
+    }
+    int64_t lo = xlo - this->r.xmin, hi = xhi - this->r.xmin;
+    x0         = clamp(left, lo, hi) + this->r.xmin;
+    x1         = clamp(right, lo, hi) + this->r.xmin;
+}
+
+void ActiveTriangle::next() {
+    ++this->y;
+    this->e[0] += this->r.b[0];
+    this->e[1] += this->r.b[1];
+    this->e[2] += this->r.b[2];
+}
+
+// Author: Blurgy <gy@blurgy.xyz>
+// Date:   Oct 17 2026, 14:05 [CST]
@@ -0,0 +1,40 @@
+#pragma once
+
+#include "Raster.hpp"
+#include "Triangle.hpp"
+#include "global.hpp"
+
+#include <array>
+
+// Entry of the scanline rasterizer's active triangle list.  Each edge of
+// the triangle bounds its spans either from the left or from the right.
+// The edge's value at the scanline's first pixel is stepped incrementally
+// from one scanline to the next, like an entry of a classic active edge
+// table, and bounds are solved from it exactly, so that spans cover the
+// same pixels as `Zbuf::_raster`.
+struct ActiveTriangle {
+    // Activate screen-space triangle `t` (with view-space counterpart `v`)
+    // at scanline `row`.
+    // @param id: Index of the triangle in the polygon table
+    ActiveTriangle(uint32_t const &id, Triangle const &t, Triangle const &v,
+                   int const &row);
+
+    // Span of the triangle on current scanline, clamped to [xlo, xhi).
+    // Pixels i in [x0, x1) are covered by the triangle, x0 >= x1 if the
+    // span is empty.
+    void span(int const &xlo, int const &xhi, int &x0, int &x1) const;
+    // Step all edges to the next scanline.
+    void next();
+
+  public:
+    uint32_t id;
+    // Setup stage of the triangle
+    Raster r;
+    // Current scanline
+    int y;
+    // Value of each edge equation at pixel (r.xmin, y)
+    std::array<int64_t, 3> e;
+};
+
+// Author: Blurgy <gy@blurgy.xyz>
+// Date:   Oct 17 2026, 14:05 [CST]
@@ -1,85 +1,339 @@
 #include "Scene.hpp"
+#include "Clip.hpp"
+#include "MappedFile.hpp"
+#include "Profiler.hpp"
 #include "global.hpp"
 
 #include <algorithm>
 #include <array>
 #include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <omp.h>
+#include <type_traits>
 
-Scene::Scene() { this->_init(); }
-Scene::Scene(objl::Mesh const &mesh) {
+// Layout of scene cache files: this header, followed by the triangles,
+// their facings, octree nodes, vertices and indices as raw arrays, in that
+// order.  Every section starts at a multiple of `alignment` bytes, so that
+// the arrays are used in place in a mapping of the file.
+struct SceneCacheHeader {
+    // Bump `version` whenever the layout of the file or of any stored type
+    // changes.
+    static uint32_t constexpr current_version = 4;
+    static size_t constexpr   alignment       = 64;
+
+    char     magic[8];
+    uint32_t version;
+    // Size of `flt`, caches are not shared between precisions
+    uint32_t flt_size;
+    uint64_t key;
+    flt      looseness;
+    uint64_t ntris, nnodes, nverts, nindices;
+
+    // Size of a section of `len` bytes, including its padding.
+    static size_t padded(size_t const &len) {
+        return (len + alignment - 1) / alignment * alignment;
+    }
+    // Total size of the file described by this header, in bytes.
+    size_t filesize() const {
+        return padded(sizeof(SceneCacheHeader)) +
+               padded(this->ntris * sizeof(Triangle)) +
+               padded(this->ntris * sizeof(vec3)) +
+               padded(this->nnodes * sizeof(Node8)) +
+               padded(this->nverts * sizeof(vec3)) +
+               padded(this->nindices * sizeof(uint32_t));
+    }
+};
+static char constexpr scene_cache_magic[8] = "ZBSCENE";
+static_assert(std::is_trivially_copyable_v<Triangle> &&
+              std::is_trivially_copyable_v<Node8>);
+static_assert(alignof(Triangle) <= SceneCacheHeader::alignment &&
+              alignof(Node8) <= SceneCacheHeader::alignment);
+
+// Geometry built by a scene, see `Scene::geometry`
+struct Scene::Geometry {
+    std::vector<Triangle> triangles;
+    std::vector<vec3>     facings;
+    std::vector<Node8>    octree;
+    std::vector<vec3>     vertices;
+    std::vector<uint32_t> indices;
+};
+
+Scene::Scene() : looseness{1} { this->_init(); }
+Scene::Scene(objl::Mesh const &mesh, flt const &looseness)
+    : looseness{looseness} {
     this->_init();
     debugm("%lu vertices found in loaded mesh\n", mesh.Vertices.size());
-    for (size_t i = 0; i < mesh.Vertices.size(); i += 3) {
-        std::array<vec3, 3> verts;
-        for (int j = 0; j < 3; ++j) {
-            vec3 vertex(mesh.Vertices[i + j].Position.X,
-                        mesh.Vertices[i + j].Position.Y,
-                        mesh.Vertices[i + j].Position.Z);
-            verts[j] = vertex;
+    std::vector<vec3> verts(mesh.Vertices.size());
+    for (size_t i = 0; i < verts.size(); ++i) {
+        objl::Vector3 const &p = mesh.Vertices[i].Position;
+        verts[i]               = vec3(p.X, p.Y, p.Z);
+    }
+    // Triangles are listed by `mesh.Indices`, polygons are already
+    // triangulated by the loader.
+    std::vector<uint32_t> ids(mesh.Indices.begin(),
+                              mesh.Indices.end() - mesh.Indices.size() % 3);
+    std::vector<Triangle> tgs;
+    for (size_t i = 0; i < ids.size(); i += 3) {
+        tgs.emplace_back(verts[ids[i]], verts[ids[i + 1]], verts[ids[i + 2]]);
+    }
+    msg("Scene created with %lu triangles\n", tgs.size());
+    this->_build_geometry(std::move(tgs), std::move(verts), std::move(ids));
+}
+Scene::Scene(ObjData const &obj, flt const &looseness)
+    : looseness{looseness} {
+    this->_init();
+    size_t ntris = obj.ntriangles();
+    debugm("%zu triangles found in parsed obj\n", ntris);
+    std::vector<vec3> verts(obj.positions.size() / 3);
+#pragma omp parallel for
+    for (size_t i = 0; i < verts.size(); ++i) {
+        verts[i] = vec3{obj.positions[3 * i + 0], obj.positions[3 * i + 1],
+                        obj.positions[3 * i + 2]};
+    }
+    // Position indices of face corners, already checked by `parse_obj`
+    std::vector<uint32_t> ids(3 * ntris);
+    std::vector<Triangle> tgs(ntris);
+#pragma omp parallel for
+    for (size_t t = 0; t < ntris; ++t) {
+        for (int i = 0; i < 3; ++i) {
+            ids[3 * t + i] = obj.corners[3 * t + i].v;
         }
-        this->realworld_triangles.emplace_back(verts[0], verts[1], verts[2]);
+        tgs[t] = Triangle{verts[ids[3 * t + 0]], verts[ids[3 * t + 1]],
+                          verts[ids[3 * t + 2]]};
+    }
+    this->_build_geometry(std::move(tgs), std::move(verts), std::move(ids));
+}
+Scene::Scene(std::vector<Triangle> const &triangles, flt const &looseness)
+    : looseness{looseness} {
+    this->_init();
+    // Triangles in the list share no vertices.
+    std::vector<vec3>     verts(3 * triangles.size());
+    std::vector<uint32_t> ids(3 * triangles.size());
+    for (size_t i = 0; i < verts.size(); ++i) {
+        verts[i] = triangles[i / 3].v[i % 3];
+        ids[i]   = i;
     }
-    msg("Scene created with %lu triangles\n", realworld_triangles.size());
-    this->_build_octree();
+    this->_build_geometry(std::vector<Triangle>(triangles), std::move(verts),
+                          std::move(ids));
 }
-Scene::Scene(std::vector<Triangle> const &triangles)
-    : realworld_triangles(triangles) {
+
+bool Scene::save(std::string const &path, uint64_t const &key) const {
+    profm("save scene cache");
+    SceneCacheHeader header;
+    std::memcpy(header.magic, scene_cache_magic, sizeof(header.magic));
+    header.version   = SceneCacheHeader::current_version;
+    header.flt_size  = sizeof(flt);
+    header.key       = key;
+    header.looseness = this->looseness;
+    header.ntris     = this->realworld_triangles.size();
+    header.nnodes    = this->octree.size();
+    header.nverts    = this->vertices.size();
+    header.nindices  = this->indices.size();
+    std::ofstream f(path, std::ios_base::out | std::ios_base::binary);
+    auto          put = [&](void const *p, size_t const &len) {
+        static char constexpr zeros[SceneCacheHeader::alignment]{};
+        f.write(static_cast<char const *>(p), len);
+        f.write(zeros, SceneCacheHeader::padded(len) - len);
+    };
+    put(&header, sizeof(header));
+    put(this->realworld_triangles.data(), header.ntris * sizeof(Triangle));
+    put(this->facings.data(), header.ntris * sizeof(vec3));
+    put(this->octree.data(), header.nnodes * sizeof(Node8));
+    put(this->vertices.data(), header.nverts * sizeof(vec3));
+    put(this->indices.data(), header.nindices * sizeof(uint32_t));
+    f.close();
+    if (!f) {
+        std::remove(path.c_str());
+        return false;
+    }
+    debugm("Scene cached in '%s'\n", path.c_str());
+    return true;
+}
+
+bool Scene::load(std::string const &path, uint64_t const &key,
+                 flt const &looseness) {
+    profm("load scene cache");
+    auto f = std::make_shared<MappedFile>(path);
+    if (!f->valid() || f->size() < sizeof(SceneCacheHeader)) {
+        return false;
+    }
+    SceneCacheHeader header;
+    std::memcpy(&header, f->data(), sizeof(header));
+    if (std::memcmp(header.magic, scene_cache_magic, sizeof(header.magic)) ||
+        header.version != SceneCacheHeader::current_version ||
+        header.flt_size != sizeof(flt) || header.key != key ||
+        header.looseness != looseness || header.filesize() != f->size() ||
+        header.nindices != 3 * header.ntris) {
+        return false;
+    }
+    // Sections are views into the mapping, nothing is copied.
+    char const *p   = f->data() + SceneCacheHeader::padded(sizeof(header));
+    auto        get = [&](auto &v, size_t const &n) {
+        using value_type = typename std::decay_t<decltype(v)>::element_type;
+        v = {reinterpret_cast<value_type *>(p), n};
+        p += SceneCacheHeader::padded(n * sizeof(value_type));
+    };
     this->_init();
-    this->_build_octree();
+    this->looseness = header.looseness;
+    get(this->realworld_triangles, header.ntris);
+    get(this->facings, header.ntris);
+    get(this->octree, header.nnodes);
+    get(this->vertices, header.nverts);
+    get(this->indices, header.nindices);
+    this->geometry = std::move(f);
+    return true;
 }
 
-std::vector<Triangle> const &Scene::primitives() const {
-    return this->viewspace_triangles;
+size_t Scene::nprimitives() const { return this->visible_triangles.size(); }
+
+Triangle Scene::primitive(size_t const &k) const {
+    uint32_t const &i     = this->visible_triangles[k];
+    size_t const    ntris = this->realworld_triangles.size();
+    Triangle        ret   = i < ntris ? this->realworld_triangles[i]
+                                      : this->clipped_triangles[i - ntris];
+    ret.v                 = this->viewspace_coords[k];
+    return ret;
 }
 
-void Scene::to_viewspace(mat4 const &mvp, vec3 const &cam_gaze) {
-    this->viewspace_triangles.clear();
-    for (auto const &t : this->realworld_triangles) {
-        // If the triangle has same facing direction as camera's gaze
-        // direction, skip it (face culling).
-        if (glm::dot(cam_gaze, t.facing) >= 0) {
-            continue;
+std::span<Triangle const> Scene::triangles() const {
+    return this->realworld_triangles;
+}
+
+void Scene::to_viewspace(mat4 const &mvp, vec3 const &cam_gaze,
+                         StatsCounter &counters) {
+    profm("to viewspace");
+    // Transform vertices
+    size_t nverts = this->vertices.size();
+    this->clip_vertices.resize(nverts);
+    this->frustum_codes.resize(nverts);
+    this->band_codes.resize(nverts);
+#pragma omp parallel for
+    for (size_t i = 0; i < nverts; ++i) {
+        this->clip_vertices[i] = to_clip(this->vertices[i], mvp);
+        this->frustum_codes[i] = outcode(this->clip_vertices[i]);
+        this->band_codes[i]    = outcode(this->clip_vertices[i], guard_band);
+    }
+
+    // Assemble triangles.  Each thread culls a contiguous range of
+    // triangles, and writes indices of surviving triangles, their view-space
+    // coordinates, and triangles produced by clipping to its own output
+    // buffers, whose capacities are kept across frames.
+    uint32_t ntris    = this->realworld_triangles.size();
+    size_t   nthreads = omp_get_max_threads();
+    if (this->thread_visible.size() < nthreads) {
+        this->thread_visible.resize(nthreads);
+        this->thread_coords.resize(nthreads);
+        this->thread_clipped.resize(nthreads);
+    }
+    // Exclusive prefix sums of output sizes of each thread
+    std::vector<size_t> visible_offsets(nthreads + 1, 0);
+    std::vector<size_t> clipped_offsets(nthreads + 1, 0);
+#pragma omp parallel
+    {
+        size_t tid = omp_get_thread_num(), nth = omp_get_num_threads();
+        std::vector<uint32_t>            &visible = this->thread_visible[tid];
+        std::vector<std::array<vec3, 3>> &coords  = this->thread_coords[tid];
+        std::vector<Triangle>            &clipped = this->thread_clipped[tid];
+        visible.clear();
+        coords.clear();
+        clipped.clear();
+        for (uint32_t i = ntris * tid / nth; i < ntris * (tid + 1) / nth;
+             ++i) {
+            // If the triangle has same facing direction as camera's gaze
+            // direction, skip it (face culling).
+            if (glm::dot(cam_gaze, this->facings[i]) >= 0) {
+                statm(counters, facing_culled, 1);
+                continue;
+            }
+            uint32_t const *idx = &this->indices[3 * i];
+            // Triangles outside the view frustum are dropped (view frustum
+            // culling).
+            if (this->frustum_codes[idx[0]] & this->frustum_codes[idx[1]] &
+                this->frustum_codes[idx[2]]) {
+                statm(counters, frustum_culled, 1);
+                continue;
+            }
+            // Triangles inside the guard band are assembled from the
+            // transformed vertices, others are clipped in homogeneous
+            // coordinates.  Triangles produced by clipping are indexed from
+            // `ntris` in each thread for now.
+            if ((this->band_codes[idx[0]] | this->band_codes[idx[1]] |
+                 this->band_codes[idx[2]]) == 0) {
+                std::array<vec3, 3> &v = coords.emplace_back();
+                for (int j = 0; j < 3; ++j) {
+                    vec4 const &c = this->clip_vertices[idx[j]];
+                    v[j]          = vec3{c.x / c.w, c.y / c.w, c.z / c.w};
+                }
+                visible.push_back(i);
+            } else {
+                size_t first = clipped.size();
+                clip(this->realworld_triangles[i],
+                     {this->clip_vertices[idx[0]],
+                      this->clip_vertices[idx[1]],
+                      this->clip_vertices[idx[2]]},
+                     clipped);
+                for (size_t j = first; j < clipped.size(); ++j) {
+                    coords.push_back(clipped[j].v);
+                    visible.push_back(ntris + j);
+                }
+            }
         }
-        // Triangle in viewspace
-        Triangle v = t * mvp;
-        for (int i = 0; i < 3; ++i) {
-            // Push viewspace triangle only when it has 1 or more vertices
-            // inside the canonical box $[-1, 1]^3$, aka view frustum culling.
-            if (v.vert_in_canonical()) {
-                viewspace_triangles.push_back(v);
-                break;
+        visible_offsets[tid + 1] = visible.size();
+        clipped_offsets[tid + 1] = clipped.size();
+#pragma omp barrier
+#pragma omp single
+        {
+            for (size_t k = 0; k < nth; ++k) {
+                visible_offsets[k + 1] += visible_offsets[k];
+                clipped_offsets[k + 1] += clipped_offsets[k];
             }
+            this->visible_triangles.resize(visible_offsets[nth]);
+            this->viewspace_coords.resize(visible_offsets[nth]);
+            this->clipped_triangles.resize(clipped_offsets[nth]);
         }
+        // Compact outputs of all threads, in the order of their ranges.
+        uint32_t shift = clipped_offsets[tid];
+        for (size_t k = 0; k < visible.size(); ++k) {
+            uint32_t const &i = visible[k];
+            this->visible_triangles[visible_offsets[tid] + k] =
+                i < ntris ? i : i + shift;
+        }
+        std::copy(coords.begin(), coords.end(),
+                  this->viewspace_coords.begin() + visible_offsets[tid]);
+        std::copy(clipped.begin(), clipped.end(),
+                  this->clipped_triangles.begin() + shift);
     }
     debugm("real world: %zu triangles, viewspace: %zu triangles\n",
            this->realworld_triangles.size(),
-           this->viewspace_triangles.size());
+           this->visible_triangles.size());
 }
 
 std::tuple<vec3, vec3, vec3> Scene::generate_camera() const {
-    if (nullptr == this->root) {
+    if (this->octree.empty()) {
         errorm("Octree is somehow not constructed\n");
     }
+    Node8 const &root = this->octree[0];
     Camera ret;
     vec3   pos, gaze, up;
     pos = vec3{
         // // Viewpoint-1
-        // this->root->maxcord[0] * 1.5,
-        // this->root->maxcord[1] * 1,
-        // this->root->maxcord[2] * 1.2,
+        // root.maxcord[0] * 1.5,
+        // root.maxcord[1] * 1,
+        // root.maxcord[2] * 1.2,
         // // Viewpoint-2
-        // this->root->maxcord[0] * 1,
-        // this->root->maxcord[1] * 2,
-        // this->root->maxcord[2] * 1,
+        // root.maxcord[0] * 1,
+        // root.maxcord[1] * 2,
+        // root.maxcord[2] * 1,
         // Viewpoint-default
-        this->root->maxcord[0] * 1.5,
-        this->root->maxcord[1] * 2,
-        this->root->maxcord[2] * 1.2,
+        root.maxcord[0] * 1.5,
+        root.maxcord[1] * 2,
+        root.maxcord[2] * 1.2,
     };
     gaze = glm::normalize(vec3{
-                              this->root->midcord[0],
-                              this->root->midcord[1],
-                              this->root->midcord[2],
+                              root.midcord[0],
+                              root.midcord[1],
+                              root.midcord[2],
                           } -
                           pos);
     up   = glm::normalize(vec3{
@@ -94,12 +348,42 @@ std::tuple<vec3, vec3, vec3> Scene::generate_camera() const {
 
 // private:
 
-void Scene::_build_octree() {
+// Octree nodes at this depth are always leaves.
+static int constexpr max_octree_depth = 32;
+// Children of octree nodes with at least this many triangles are built in
+// parallel.
+static uint32_t constexpr parallel_build_cutoff = 1 << 14;
+
+void Scene::_build_geometry(std::vector<Triangle> &&tgs,
+                            std::vector<vec3> &&verts,
+                            std::vector<uint32_t> &&ids) {
+    auto g       = std::make_shared<Geometry>();
+    g->triangles = std::move(tgs);
+    g->vertices  = std::move(verts);
+    g->indices   = std::move(ids);
+    this->_build_octree(*g);
+    g->facings.resize(g->triangles.size());
+#pragma omp parallel for
+    for (size_t i = 0; i < g->triangles.size(); ++i) {
+        g->facings[i] = g->triangles[i].facing;
+    }
+    debugm("%zu vertices in %zu triangles\n", g->vertices.size(),
+           g->triangles.size());
+    this->realworld_triangles = g->triangles;
+    this->facings             = g->facings;
+    this->octree              = g->octree;
+    this->vertices            = g->vertices;
+    this->indices             = g->indices;
+    this->geometry            = std::move(g);
+}
+
+void Scene::_build_octree(Geometry &g) {
+    profm("build octree");
     debugm("Constructing octree in object space ..\n");
     flt xmin{std::numeric_limits<flt>::max()}, ymin{xmin}, zmin{xmin};
     flt xmax{-std::numeric_limits<flt>::max()}, ymax{xmax}, zmax{xmax};
     // Determine size of root node
-    for (Triangle const &t : this->realworld_triangles) {
+    for (Triangle const &t : g.triangles) {
         xmin = std::min(std::min(xmin, t.a().x), std::min(t.b().x, t.c().x));
         ymin = std::min(std::min(ymin, t.a().y), std::min(t.b().y, t.c().y));
         zmin = std::min(std::min(zmin, t.a().z), std::min(t.b().z, t.c().z));
@@ -107,68 +391,169 @@ void Scene::_build_octree() {
         ymax = std::max(std::max(ymax, t.a().y), std::max(t.b().y, t.c().y));
         zmax = std::max(std::max(zmax, t.a().z), std::max(t.b().z, t.c().z));
     }
-    this->root = this->_build(xmin - epsilon, ymin - epsilon, zmin - epsilon,
-                              xmax + epsilon, ymax + epsilon, zmax + epsilon,
-                              this->realworld_triangles, nullptr);
+    // Indices of triangles, partitioned by nodes during construction
+    uint32_t              n = g.triangles.size();
+    std::vector<uint32_t> order(n), scratch(n);
+    for (uint32_t i = 0; i < n; ++i) {
+        order[i] = i;
+    }
+    g.octree.clear();
+#pragma omp parallel
+#pragma omp single
+    this->_build(xmin - epsilon, ymin - epsilon, zmin - epsilon,
+                 xmax + epsilon, ymax + epsilon, zmax + epsilon, 0, n,
+                 Node8::none, 0, g.triangles, g.octree, order, scratch);
+    g.octree.shrink_to_fit();
+    // Sort triangles and their indices in the order of nodes.
+    std::vector<Triangle> sorted(n);
+    std::vector<uint32_t> sorted_indices(3 * n);
+#pragma omp parallel for
+    for (uint32_t i = 0; i < n; ++i) {
+        sorted[i] = g.triangles[order[i]];
+        for (int j = 0; j < 3; ++j) {
+            sorted_indices[3 * i + j] = g.indices[3 * order[i] + j];
+        }
+    }
+    g.triangles.swap(sorted);
+    g.indices.swap(sorted_indices);
     msg("Object space octree constructed\n");
 }
 
-Node8 *Scene::_build(flt const &xmin, flt const &ymin, flt const &zmin,
-                     flt const &xmax, flt const &ymax, flt const &zmax,
-                     std::vector<Triangle> const &prims, Node8 *fa) {
+uint32_t Scene::_build(flt const &xmin, flt const &ymin, flt const &zmin,
+                       flt const &xmax, flt const &ymax, flt const &zmax,
+                       uint32_t const &first, uint32_t const &last,
+                       uint32_t const &fa, int const &depth,
+                       std::vector<Triangle> const &tgs,
+                       std::vector<Node8> &nodes, std::vector<uint32_t> &order,
+                       std::vector<uint32_t> &scratch) {
     // Do not create a node if there is no primitive inside given cubic area.
-    if (prims.size() == 0) {
-        return nullptr;
-    }
-    // Pointer to constructed octree node.
-    Node8 *ret = new Node8{xmin, ymin, zmin, xmax, ymax, zmax};
-    ret->fa    = fa;
-    // Stop subdividing when number of primitives inside cube is less than 24.
-    if (prims.size() < 24) {
-        ret->isleaf = true;
+    if (first == last) {
+        return Node8::none;
+    }
+    // Index of constructed octree node.  NOTE: References to nodes are
+    // invalidated when nodes are appended to `nodes`.
+    uint32_t ret = nodes.size();
+    // The cube is expanded by half of (looseness - 1) times its size on
+    // each side.  The root cube already bounds the whole scene, and is kept
+    // as is.
+    std::array<flt, 3> const lo{xmin, ymin, zmin};
+    std::array<flt, 3> const hi{xmax, ymax, zmax};
+    std::array<flt, 3>       pad{0, 0, 0};
+    for (int k = 0; depth > 0 && k < 3; ++k) {
+        pad[k] = (this->looseness - 1) / 2 * (hi[k] - lo[k]);
+    }
+    nodes.emplace_back(xmin - pad[0], ymin - pad[1], zmin - pad[2],
+                       xmax + pad[0], ymax + pad[1], zmax + pad[2]);
+    nodes[ret].fa    = fa;
+    nodes[ret].tdep  = depth;
+    nodes[ret].first = first;
+    // Stop subdividing when number of primitives inside cube is less than
+    // 24, or when the cube is too small to be split any further.
+    if (last - first < 24 || depth >= max_octree_depth) {
+        nodes[ret].isleaf = true;
         // Associate all primitives (less than 24) to current node.
-        ret->prims.assign(prims.begin(), prims.end());
+        nodes[ret].count = last - first;
         return ret;
     }
-    // Otherwise, subdivide current cube.
-    std::array<std::vector<Triangle>, 8> subprims;
-    for (auto const &t : prims) {
-        if (ret->owns(t)) {
-            ret->prims.push_back(t);
-        } else {
-            subprims[ret->index(t)].push_back(t);
+    // Otherwise, subdivide current cube.  Triangles are stably sorted by
+    // their buckets: the node's own primitives come first, then those of
+    // each child.
+    Node8 const &node   = nodes[ret];
+    auto         bucket = [&](uint32_t const &i) -> uint32_t {
+        Triangle const &t = tgs[i];
+        if (this->looseness <= 1) {
+            return node.owns(t) ? 0 : node.index(t) + 1;
+        }
+        // Child containing the triangle's centroid, and whether the
+        // triangle fits in its expanded cube.
+        BBox const &box = t.boundingbox();
+        vec3        c   = box.centroid();
+        uint32_t    idx = 0;
+        for (int k = 0; k < 3; ++k) {
+            bool upper = c[k] > node.midcord[k];
+            flt  cmin  = upper ? node.midcord[k] : lo[k];
+            flt  cmax  = upper ? hi[k] : node.midcord[k];
+            flt  cpad  = (this->looseness - 1) / 2 * (cmax - cmin);
+            if (box.minp[k] < cmin - cpad || box.maxp[k] > cmax + cpad) {
+                return 0;
+            }
+            idx |= upper << k;
         }
+        return idx + 1;
+    };
+    // Counting sort, offsets[k + 1] starts as the size of bucket k
+    std::array<uint32_t, 10> offsets{0};
+    for (uint32_t i = first; i < last; ++i) {
+        ++offsets[bucket(order[i]) + 1];
+    }
+    offsets[0] = first;
+    for (int k = 0; k < 9; ++k) {
+        offsets[k + 1] += offsets[k];
+    }
+    std::array<uint32_t, 9> pos;
+    std::copy(offsets.begin(), offsets.end() - 1, pos.begin());
+    for (uint32_t i = first; i < last; ++i) {
+        scratch[pos[bucket(order[i])]++] = order[i];
     }
+    std::copy(scratch.begin() + first, scratch.begin() + last,
+              order.begin() + first);
+    nodes[ret].count = offsets[1] - offsets[0];
 
-    ret->children[0] =
-        this->_build(xmin, ymin, zmin, ret->midcord[0], ret->midcord[1],
-                     ret->midcord[2], subprims[0], ret);
-    ret->children[1] =
-        this->_build(ret->midcord[0], ymin, zmin, xmax, ret->midcord[1],
-                     ret->midcord[2], subprims[1], ret);
-    ret->children[2] =
-        this->_build(xmin, ret->midcord[1], zmin, ret->midcord[0], ymax,
-                     ret->midcord[2], subprims[2], ret);
-    ret->children[3] =
-        this->_build(ret->midcord[0], ret->midcord[1], zmin, xmax, ymax,
-                     ret->midcord[2], subprims[3], ret);
-    ret->children[4] =
-        this->_build(xmin, ymin, ret->midcord[2], ret->midcord[0],
-                     ret->midcord[1], zmax, subprims[4], ret);
-    ret->children[5] =
-        this->_build(ret->midcord[0], ymin, ret->midcord[2], xmax,
-                     ret->midcord[1], zmax, subprims[5], ret);
-    ret->children[6] =
-        this->_build(xmin, ret->midcord[1], ret->midcord[2], ret->midcord[0],
-                     ymax, zmax, subprims[6], ret);
-    ret->children[7] =
-        this->_build(ret->midcord[0], ret->midcord[1], ret->midcord[2], xmax,
-                     ymax, zmax, subprims[7], ret);
+    std::array<flt, 3> const mid = node.midcord;
+    // Bit k of the child's index tells which half of axis k it takes.
+    auto build_child = [&](size_t const &c, uint32_t const &cfa,
+                           std::vector<Node8> &cnodes) {
+        std::array<flt, 3> cmin, cmax;
+        for (int k = 0; k < 3; ++k) {
+            cmin[k] = (c >> k & 1) ? mid[k] : lo[k];
+            cmax[k] = (c >> k & 1) ? hi[k] : mid[k];
+        }
+        return this->_build(cmin[0], cmin[1], cmin[2], cmax[0], cmax[1],
+                            cmax[2], offsets[c + 1], offsets[c + 2], cfa,
+                            depth + 1, tgs, cnodes, order, scratch);
+    };
+    if (last - first < parallel_build_cutoff) {
+        for (size_t c = 0; c < 8; ++c) {
+            uint32_t child         = build_child(c, ret, nodes);
+            nodes[ret].children[c] = child;
+        }
+        return ret;
+    }
+    // Large subtrees are built as tasks, each into its own node array.
+    // Their triangle ranges are disjoint, so that they partition `order` and
+    // `scratch` independently.  The arrays are then appended in the order of
+    // children, which yields the same preorder layout as a serial build.
+    std::array<std::vector<Node8>, 8> subtrees;
+    for (size_t c = 0; c < 8; ++c) {
+#pragma omp task default(shared) firstprivate(c)
+        build_child(c, Node8::none, subtrees[c]);
+    }
+#pragma omp taskwait
+    for (size_t c = 0; c < 8; ++c) {
+        if (subtrees[c].empty()) {
+            continue;
+        }
+        uint32_t offset        = nodes.size();
+        nodes[ret].children[c] = offset;
+        for (Node8 &n : subtrees[c]) {
+            n.fa = n.fa == Node8::none ? ret : n.fa + offset;
+            for (uint32_t &child : n.children) {
+                if (child != Node8::none) {
+                    child += offset;
+                }
+            }
+        }
+        nodes.insert(nodes.end(), subtrees[c].begin(), subtrees[c].end());
+    }
 
     return ret;
 }
 
-void Scene::_init() { viewspace_triangles.clear(); }
+void Scene::_init() {
+    this->visible_triangles.clear();
+    this->viewspace_coords.clear();
+    this->clipped_triangles.clear();
+}
 
 // Author: Blurgy <gy@blurgy.xyz>
 // Date:   Nov 23 2020, 15:38 [CST]
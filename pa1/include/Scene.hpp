@@ -2,96 +2,46 @@
 
 #include "Camera.hpp"
 #include "OBJ_Loader.hpp"
+#include "ObjParser.hpp"
+#include "Stats.hpp"
 #include "Triangle.hpp"
 #include "global.hpp"
 
 #include <array>
+#include <limits>
+#include <memory>
+#include <span>
+#include <string>
 #include <tuple>
 #include <vector>
 
-// Node of a full octree.
+// Node of a full octree.  Nodes are stored contiguously in preorder, and
+// refer to each other (and to their triangles) by 32-bit indices.
+//
+// In a loose octree, the cube of each node is its share of the father's
+// cube (the core) expanded by a looseness factor around the same center,
+// so cubes of siblings overlap.  `mincord` and `maxcord` are always the
+// expanded (loose) bounds, which contain all triangles in the subtree.
 struct Node8 : Node<8> {
+    // Index of a nonexistent node
+    static uint32_t constexpr none = std::numeric_limits<uint32_t>::max();
+
     Node8(flt xmin = 0, flt ymin = 0, flt zmin = 0, flt xmax = 0,
           flt ymax = 0, flt zmax = 0)
-        : children{nullptr},         // Initialize child nodes to nullptr
+        : fa{none},                  // No father by default
+          first{0}, count{0},        // No associated primitives by default
           mincord{xmin, ymin, zmin}, // Min values of current cube
           maxcord{xmax, ymax, zmax}  // Max values of current cube
     {
+        children.fill(none); // Initialize child nodes to none
         for (int i = 0; i < 3; ++i) {
             midcord[i] = (mincord[i] + maxcord[i]) / 2;
         }
-
-        /* Generate facets of corresponding cube of current node */
-        // xOz
-        facets[0] = Triangle{{
-            vec3{xmin, ymin, zmin},
-            vec3{xmax, ymin, zmin},
-            vec3{xmax, ymin, zmax},
-        }};
-        facets[1] = Triangle{{
-            vec3{xmin, ymin, zmin},
-            vec3{xmax, ymin, zmax},
-            vec3{xmin, ymin, zmax},
-        }};
-        facets[6] = Triangle{{
-            vec3{xmin, ymax, zmin},
-            vec3{xmax, ymax, zmax},
-            vec3{xmax, ymax, zmin},
-        }};
-        facets[7] = Triangle{{
-            vec3{xmin, ymax, zmin},
-            vec3{xmin, ymax, zmax},
-            vec3{xmax, ymax, zmax},
-        }};
-
-        // yOz
-        facets[2] = Triangle{{
-            vec3{xmin, ymin, zmin},
-            vec3{xmin, ymin, zmax},
-            vec3{xmin, ymax, zmax},
-        }};
-        facets[3] = Triangle{{
-            vec3{xmin, ymin, zmin},
-            vec3{xmin, ymax, zmax},
-            vec3{xmin, ymax, zmin},
-        }};
-        facets[8] = Triangle{{
-            vec3{xmax, ymin, zmin},
-            vec3{xmax, ymax, zmax},
-            vec3{xmax, ymin, zmax},
-        }};
-        facets[9] = Triangle{{
-            vec3{xmax, ymin, zmin},
-            vec3{xmax, ymax, zmin},
-            vec3{xmax, ymax, zmax},
-        }};
-
-        // xOy
-        facets[4]  = Triangle{{
-            vec3{xmin, ymin, zmin},
-            vec3{xmax, ymax, zmin},
-            vec3{xmax, ymin, zmin},
-        }};
-        facets[5]  = Triangle{{
-            vec3{xmin, ymin, zmin},
-            vec3{xmin, ymax, zmin},
-            vec3{xmax, ymax, zmin},
-        }};
-        facets[10] = Triangle{{
-            vec3{xmin, ymin, zmax},
-            vec3{xmax, ymin, zmax},
-            vec3{xmax, ymax, zmax},
-        }};
-        facets[11] = Triangle{{
-            vec3{xmin, ymin, zmax},
-            vec3{xmax, ymax, zmax},
-            vec3{xmin, ymax, zmax},
-        }};
     }
 
     // Check if triangle `t` lies on any of the dividing planes of the cube
     // associated with current node.
-    bool owns(Triangle const &t) {
+    bool owns(Triangle const &t) const {
         assert(this->mincord[0] < t.a().x && t.a().x < this->maxcord[0]);
         assert(this->mincord[0] < t.b().x && t.b().x < this->maxcord[0]);
         assert(this->mincord[0] < t.c().x && t.c().x < this->maxcord[0]);
@@ -119,7 +69,7 @@ struct Node8 : Node<8> {
     // cube associated with current node, returns the index of the child that
     // `t` should be assigned to.
     // Returned index is an integer in range [0, 8], aka [000, 111].
-    size_t index(Triangle const &t) {
+    size_t index(Triangle const &t) const {
         unsigned char masks[3];
         masks[0] = (t.a().x > this->midcord[0]);      // Lowest bit for x
         masks[1] = (t.a().y > this->midcord[1]) << 1; // Second bit for y
@@ -128,9 +78,12 @@ struct Node8 : Node<8> {
     }
 
     // Father
-    Node8 *fa;
+    uint32_t fa;
     // Children
-    std::array<Node8 *, 8> children;
+    std::array<uint32_t, 8> children;
+    // Associated primitives, as a range [first, first + count) of the
+    // scene's triangles
+    uint32_t first, count;
 
     // Min values of current cube (0:x, 1:y, 2:z)
     std::array<flt, 3> mincord;
@@ -138,52 +91,145 @@ struct Node8 : Node<8> {
     std::array<flt, 3> maxcord;
     // Splitting values (0:x, 1:y, 2:z)
     std::array<flt, 3> midcord;
-    // 6 faces, 2 triangles per face.
-    std::array<Triangle, 12> facets;
-    // Associated primitives
-    std::vector<Triangle> prims;
 };
 
 class Scene {
   private:
-    // Triangles with real-world coordinates
-    std::vector<Triangle> realworld_triangles;
-
-    // Triangles with view-space coordinates
-    std::vector<Triangle> viewspace_triangles;
+    // Storage of a built scene's geometry, defined in Scene.cpp
+    struct Geometry;
+
+    // Owner of the read-only geometry viewed by `realworld_triangles`,
+    // `facings`, `vertices`, `indices` and `octree`: either a `Geometry`
+    // built by this scene, or the mapping of a cache file.  Copies of a
+    // scene share it.
+    std::shared_ptr<void const> geometry;
+
+    // Triangles with real-world coordinates, sorted so that primitives of
+    // each octree node are contiguous
+    std::span<Triangle const> realworld_triangles;
+    // Facing directions of `realworld_triangles`, packed for face culling
+    std::span<vec3 const> facings;
+
+    // Vertex buffer, real-world coordinates of the vertices of the source
+    // mesh
+    std::span<vec3 const> vertices;
+    // Index buffer, every 3 consecutive indices into `vertices` make up the
+    // triangle in `realworld_triangles` at the same position
+    std::span<uint32_t const> indices;
+    // Post-transform vertex buffer, clip-space coordinates of `vertices` in
+    // current frame
+    std::vector<vec4> clip_vertices;
+    // Outcodes of `clip_vertices` against the view frustum, and against the
+    // guard band
+    std::vector<unsigned> frustum_codes, band_codes;
+
+    // Triangles to be drawn in current frame, as the triangles their
+    // attributes come from, i.e. indices into `realworld_triangles`, or
+    // `realworld_triangles.size()` plus indices into `clipped_triangles`
+    std::vector<uint32_t> visible_triangles;
+    // View-space coordinates of the vertices of `visible_triangles`,
+    // assembled from `clip_vertices`
+    std::vector<std::array<vec3, 3>> viewspace_coords;
+    // View-space triangles produced by clipping in current frame
+    std::vector<Triangle> clipped_triangles;
+    // Per-thread output buffers of `to_viewspace`: `visible_triangles`,
+    // `viewspace_coords` and `clipped_triangles` of each thread's range
+    std::vector<std::vector<uint32_t>>            thread_visible;
+    std::vector<std::vector<std::array<vec3, 3>>> thread_coords;
+    std::vector<std::vector<Triangle>>            thread_clipped;
 
   private:
     void _init();
 
+    // Build the scene's geometry from real-world triangles `tgs`, whose
+    // vertices are listed by every 3 consecutive indices `ids` into vertex
+    // buffer `verts`, as the source mesh indexes them.
+    void _build_geometry(std::vector<Triangle> &&tgs,
+                         std::vector<vec3> &&verts,
+                         std::vector<uint32_t> &&ids);
+
     // This function is the frontend of octree construction.
     // It is called upon succesfully load of mesh triangles, the octree is
-    // built upon all real world triangles.
-    void _build_octree();
-
-    // Actual octree recursive construction function
-    Node8 *_build(flt const &xmin, flt const &ymin, flt const &zmin,
-                  flt const &xmax, flt const &ymax, flt const &zmax,
-                  std::vector<Triangle> const &prims, Node8 *fa);
+    // built upon all real world triangles in `g`, which are then sorted in
+    // the order of nodes, together with their indices.
+    void _build_octree(Geometry &g);
+
+    // Actual octree recursive construction function.  Builds the subtree
+    // for triangles `tgs[order[first, last)]` inside the core cube
+    // [xmin, xmax] x [ymin, ymax] x [zmin, zmax], appends its nodes to
+    // `nodes` in preorder, and partitions the range in place so that
+    // primitives of each node in the subtree are contiguous.  `scratch` is a
+    // buffer of the same size as `order`.  Subtrees of large nodes are built
+    // as OpenMP tasks, so this should be called inside a parallel region.
+    // @return: Index of the subtree's root in `nodes`
+    uint32_t _build(flt const &xmin, flt const &ymin, flt const &zmin,
+                    flt const &xmax, flt const &ymax, flt const &zmax,
+                    uint32_t const &first, uint32_t const &last,
+                    uint32_t const &fa, int const &depth,
+                    std::vector<Triangle> const &tgs,
+                    std::vector<Node8> &nodes, std::vector<uint32_t> &order,
+                    std::vector<uint32_t> &scratch);
+
+    // Looseness factor of the octree.  With a factor of 1, triangles
+    // crossing any splitting plane of a node stay in the node.  With a
+    // factor k > 1, every cube is expanded to k times its size, triangles
+    // go to the child containing their centroid as long as they fit in the
+    // child's expanded cube.
+    flt looseness;
 
   public:
-    // Root node of object space octree
-    Node8 *root;
+    // Nodes of object space octree in preorder, the root node comes first
+    std::span<Node8 const> octree;
 
   public:
     Scene();
     // Construct a scene with loaded mesh
-    Scene(objl::Mesh const &mesh);
+    // @param looseness: Looseness factor of the octree, 1 for a regular
+    //                   octree
+    Scene(objl::Mesh const &mesh, flt const &looseness = 1);
+    // Construct a scene with geometry parsed by `parse_obj`
+    Scene(ObjData const &obj, flt const &looseness = 1);
     // Construct a scene with a list of triangles
-    Scene(std::vector<Triangle> const &tgs);
-
-    std::vector<Triangle> const &primitives() const;
+    Scene(std::vector<Triangle> const &tgs, flt const &looseness = 1);
+
+    // Serialize the built scene (triangles in octree order, octree nodes
+    // and vertex/index buffers) to a binary cache file at `path`.
+    // @param key: Identifies the source of the scene, e.g. `hash_file` of
+    //             the obj file, so that edits of the file invalidate the
+    //             cache
+    // @return: Whether the file is written successfully
+    bool save(std::string const &path, uint64_t const &key) const;
+    // Restore a scene from cache file `path` written by `save`.  The
+    // geometry is used in place in a mapping of the file, which lives as
+    // long as the scene or any copy of it.  Fails if the file does not
+    // exist, was written by another version of the format, or does not
+    // match `key` and `looseness`, in which case the scene is left
+    // unchanged.
+    // @return: Whether the scene is loaded from cache
+    bool load(std::string const &path, uint64_t const &key,
+              flt const &looseness = 1);
+
+    // Number of view-space triangles to be drawn in current frame.
+    size_t nprimitives() const;
+    // View-space triangle `k` (< `nprimitives()`) to be drawn in current
+    // frame, triangles are numbered in the order of their real-world
+    // counterparts.  Each call assembles the triangle from its coordinates
+    // and the attributes of the triangle it comes from, callers keep it
+    // around as long as they need it.
+    Triangle primitive(size_t const &k) const;
+    // Triangles with real-world coordinates, indexed by octree nodes.
+    std::span<Triangle const> triangles() const;
 
     // Transform loaded triangles into viewspace, in viewspace, the observer
     // (camera) rests at position (0, 0, 0) and has gaze direction (0, 0, -1),
-    // with up direction (0, 1, 0).
+    // with up direction (0, 1, 0).  Each vertex is transformed only once,
+    // triangles are then assembled from the transformed vertices.
     // @param      mvp: Model-view-projection matrix
     // @param cam_gaze: Camera's gaze direction for face culling
-    void to_viewspace(mat4 const &mvp, vec3 const &cam_gaze);
+    // @param counters: Counts triangles culled by facing and by the view
+    //                  frustum
+    void to_viewspace(mat4 const &mvp, vec3 const &cam_gaze,
+                      StatsCounter &counters);
 
     // Generate a camera object according to primitives' coordinates
     // @return A tuple of 3 unit vectors: (`pos`, `gaze`, `up`)
@@ -0,0 +1,69 @@
+#include "Stats.hpp"
+
+#include <omp.h>
+
+RenderStats &RenderStats::operator+=(RenderStats const &rhs) {
+    this->facing_culled += rhs.facing_culled;
+    this->frustum_culled += rhs.frustum_culled;
+    this->pyramid_culled += rhs.pyramid_culled;
+    this->nodes_visited += rhs.nodes_visited;
+    this->nodes_culled += rhs.nodes_culled;
+    this->nodes_queried += rhs.nodes_queried;
+    this->occluders += rhs.occluders;
+    this->occlusion_culled += rhs.occlusion_culled;
+    this->pixels_tested += rhs.pixels_tested;
+    this->pixels_passed += rhs.pixels_passed;
+    this->pixels_accepted += rhs.pixels_accepted;
+    this->shaded += rhs.shaded;
+    this->setz_steps += rhs.setz_steps;
+    this->pyramid_tests += rhs.pyramid_tests;
+    this->lca_levels += rhs.lca_levels;
+    return *this;
+}
+
+flt RenderStats::average_lca_level() const {
+    return this->pyramid_tests == 0
+               ? 0
+               : 1.0 * this->lca_levels / this->pyramid_tests;
+}
+
+void RenderStats::report() const {
+    if (!STATISTICS) {
+        return;
+    }
+    msg("    culled: %lu by facing, %lu by frustum, %lu by z-pyramid\n",
+        this->facing_culled, this->frustum_culled, this->pyramid_culled);
+    msg("    octree: %lu nodes visited, %lu culled, %lu queried\n",
+        this->nodes_visited, this->nodes_culled, this->nodes_queried);
+    msg("    occlusion: %lu occluders, %lu culled\n", this->occluders,
+        this->occlusion_culled);
+    msg("    pixels: %lu tested, %lu passed (%.1f%%), %lu accepted, %lu "
+        "shaded\n",
+        this->pixels_tested, this->pixels_passed,
+        this->pixels_tested == 0
+            ? 0.0
+            : 100.0 * this->pixels_passed / this->pixels_tested,
+        this->pixels_accepted, this->shaded);
+    msg("    z-pyramid: %lu setz steps, %lu tests at level %.2f on "
+        "average\n",
+        this->setz_steps, this->pyramid_tests, this->average_lca_level());
+}
+
+void StatsCounter::reset() {
+    this->slots.assign(omp_get_max_threads(), Slot{});
+}
+
+RenderStats &StatsCounter::local() {
+    return this->slots[omp_get_thread_num()].stats;
+}
+
+RenderStats StatsCounter::total() const {
+    RenderStats ret;
+    for (Slot const &s : this->slots) {
+        ret += s.stats;
+    }
+    return ret;
+}
+
+// Author: Blurgy <gy@blurgy.xyz>
+// Date:   Oct 17 2026, 19:45 [CST]
@@ -0,0 +1,90 @@
+#pragma once
+
+#include "global.hpp"
+
+#include <cstdint>
+#include <vector>
+
+// Counters are only compiled in when `ZBUF_STATS` is defined (configure
+// with `-DZBUF_STATS=ON`), otherwise `statm` expands to nothing and the
+// compiler drops the counting code.
+#ifdef ZBUF_STATS
+#define STATISTICS 1
+#else
+#define STATISTICS 0
+#endif
+// Add `n` to counter `field` of the calling thread in `counters` (a
+// `StatsCounter`).
+#define statm(counters, field, n)                                            \
+    do {                                                                     \
+        if (STATISTICS) {                                                    \
+            (counters).local().field += (n);                                 \
+        }                                                                    \
+    } while (0)
+
+// Culling and overdraw counters of a frame.
+struct RenderStats {
+    // Triangles rejected by face culling
+    uint64_t facing_culled{0};
+    // Triangles rejected by view frustum culling
+    uint64_t frustum_culled{0};
+    // Triangles rejected by `Pyramid::visible`.  The tiled method tests
+    // each triangle once per tile it is binned into.
+    uint64_t pyramid_culled{0};
+    // Octree nodes visited, and nodes rejected with their subtrees (by the
+    // view frustum or by `Pyramid::visible`)
+    uint64_t nodes_visited{0};
+    uint64_t nodes_culled{0};
+    // Octree nodes invisible in last frame, tested in a batch by
+    // `rendering_method::coherent`
+    uint64_t nodes_queried{0};
+    // Occluders drawn into `OcclusionBuffer`, and octree nodes and
+    // triangles passing `Pyramid::visible` but rejected by it
+    uint64_t occluders{0};
+    uint64_t occlusion_culled{0};
+    // Pixels inside triangles whose depth is compared, and those passing
+    // the depth test
+    uint64_t pixels_tested{0};
+    uint64_t pixels_passed{0};
+    // Pixels written without depth tests, in raster blocks accepted by
+    // `Pyramid::nearer`
+    uint64_t pixels_accepted{0};
+    // Fragment shader invocations
+    uint64_t shaded{0};
+    // Texels of upper levels updated by `Pyramid::setz` and
+    // `Pyramid::update`
+    uint64_t setz_steps{0};
+    // Queries to `Pyramid::visible`, and the sum of levels of their tested
+    // texels, i.e. of the lowest common ancestors of the tested areas
+    uint64_t pyramid_tests{0};
+    uint64_t lca_levels{0};
+
+    RenderStats &operator+=(RenderStats const &rhs);
+
+    // Average level of texels tested by `Pyramid::visible`.
+    flt average_lca_level() const;
+    // Print the counters, does nothing unless counters are compiled in.
+    void report() const;
+};
+
+// Per-thread `RenderStats`, each thread only writes its own slot, so no
+// synchronization is needed.  Slots are cache-line aligned so that threads
+// do not share cache lines.
+class StatsCounter {
+  private:
+    struct alignas(64) Slot {
+        RenderStats stats;
+    };
+    std::vector<Slot> slots;
+
+  public:
+    // Zero all counters, with one slot for each OpenMP thread.
+    void reset();
+    // Counters of the calling thread.
+    RenderStats &local();
+    // Sum of all threads' counters.
+    RenderStats total() const;
+};
+
+// Author: Blurgy <gy@blurgy.xyz>
+// Date:   Oct 17 2026, 19:45 [CST]
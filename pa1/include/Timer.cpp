@@ -6,8 +6,14 @@ void Timer::start() { this->start_time = clk::now(); }
 void Timer::end() { this->end_time = clk::now(); }
 
 double Timer::elapsedms() {
-    return std::chrono::duration_cast<std::chrono::milliseconds>(
-               this->end_time - this->start_time)
+    return std::chrono::duration<double, std::milli>(this->end_time -
+                                                     this->start_time)
+        .count();
+}
+
+double Timer::nowms() const {
+    return std::chrono::duration<double, std::milli>(clk::now() -
+                                                     this->start_time)
         .count();
 }
 
@@ -18,8 +18,10 @@ class Timer {
     void start();
     // Pause the timer
     void end();
-    // Get elapsed time in miliseconds.
+    // Get elapsed time in miliseconds, with fractional part.
     double elapsedms();
+    // Get time since the timer started in miliseconds, without pausing it.
+    double nowms() const;
 };
 
 // Author: Blurgy <gy@blurgy.xyz>
@@ -1,6 +1,19 @@
 #include "Zbuf.hpp"
+#include "Clip.hpp"
+#include "Profiler.hpp"
+#include "Scanline.hpp"
 #include "glm/gtc/type_ptr.hpp"
 
+#include <algorithm>
+#include <bit>
+
+// Raster blocks must not span multiple epoch tiles of the depth buffer.
+static_assert(raster_block <= (1 << Pyramid::epoch_level));
+
+// Level of the smallest z-pyramid texels tested against by the scanline
+// rasterizer.
+static int constexpr scanline_run_level = 2;
+
 Zbuf::Zbuf() { this->_init(); }
 Zbuf::Zbuf(Scene const &s) : scene{s} { this->_init(); }
 Zbuf::Zbuf(Scene const &s, size_t const &width, size_t const &height)
@@ -9,11 +22,30 @@ Zbuf::Zbuf(Scene const &s, size_t const &width, size_t const &height)
     this->init_viewport(width, height);
 }
 
-Image const &Zbuf::image() const { return this->img; }
+Image const &Zbuf::image() const {
+    if (!this->img_resolved) {
+        size_t n = size_t{1} << this->zpyramid.epoch_tile_level();
+        for (size_t y = 0; y < this->h; y += n) {
+            for (size_t x = 0; x < this->w; x += n) {
+                if (this->zpyramid.stale(x, y)) {
+                    this->_clear_tile(x, y);
+                }
+            }
+        }
+        this->img_resolved = true;
+    }
+    return this->img;
+}
+
+std::array<flt, nstages> const &Zbuf::stage_times() const {
+    return this->stage_ms;
+}
+
+RenderStats Zbuf::frame_stats() const { return this->counters.total(); }
 
 void Zbuf::reset() {
-    this->img.fill();
-    this->zpyramid.clear(this->zpyramid.root);
+    this->zpyramid.clear();
+    this->img_resolved = false;
 }
 
 void Zbuf::set_shader(
@@ -21,6 +53,7 @@ void Zbuf::set_shader(
                         std::tuple<flt, flt, flt> const &barycentric)>
         shader_func) {
     this->frag_shader = shader_func;
+    this->shader      = shdr::lookup(shader_func);
 }
 
 void Zbuf::init_cam(vec3 const &ey, flt const &fovy, flt const &aspect_ratio,
@@ -111,11 +144,12 @@ void Zbuf::init_viewport(const size_t &width, const size_t &height) {
         0, 0, 1, 0,
         0, 0, 0, 1,
     };
+    flt const hw = static_cast<flt>(w * 0.5), hh = static_cast<flt>(h * 0.5);
     flt vscale_value[] = {
-        w*0.5,     0, 0, 0,
-            0, h*0.5, 0, 0,
-            0,     0, 1, 0,
-            0,     0, 0, 1,
+        hw,  0, 0, 0,
+         0, hh, 0, 0,
+         0,  0, 1, 0,
+         0,  0, 0, 1,
     };
     // clang-format on
     mat4 vtrans = glm::make_mat4(vtrans_value);
@@ -125,7 +159,12 @@ void Zbuf::init_viewport(const size_t &width, const size_t &height) {
     this->img.init(this->w, this->h);
     // Initilize the depth buffer, initial values are infinitely far (negative
     // infinity).
-    this->zpyramid             = Pyramid(this->h, this->w);
+    this->zpyramid  = Pyramid(this->h, this->w);
+    this->occlusion = OcclusionBuffer(this->h, this->w);
+    this->_init_tiles();
+    this->vis_ids.init(this->w, this->h);
+    this->vis_barycentrics.init(this->w, this->h);
+    this->polygon_table.assign(this->h, std::vector<uint32_t>{});
     this->viewport_initialized = true;
 }
 
@@ -139,174 +178,809 @@ void Zbuf::render(rendering_method const &type) {
     if (!this->viewport_initialized) {
         errorm("Viewport size is not initialized\n");
     }
-    if (type == rendering_method::octree) {
-        this->_render_with_octree(this->scene.root);
+    profm("render");
+    // Depth values of visible points lie between the near plane and the
+    // limit at infinite distance of the projection.
+    flt n = this->cam.znear(), f = this->cam.zfar();
+    this->zpyramid.set_range((n + f) / 2 / std::fabs(f - n), ndc_near);
+    this->img_resolved = false;
+    this->stage_ms.fill(0);
+    this->counters.reset();
+    this->stage_timer.start();
+    // Select the rasterizers once for the whole frame.
+    switch (this->shader) {
+    case shdr::normal:
+        this->_render(type, shdr::Normal{});
+        break;
+    case shdr::vertex_interpolation:
+        this->_render(type, shdr::VertexInterpolation{});
+        break;
+    default:
+        this->_render(type, this->frag_shader);
+    }
+}
+
+// private:
+template <typename Shader>
+void Zbuf::_render(rendering_method const &type, Shader const &shader) {
+    this->use_occluders = type == rendering_method::masked;
+    if (this->node_visible.size() != this->scene.octree.size()) {
+        this->node_visible.assign(this->scene.octree.size(), true);
+    }
+    if (type == rendering_method::coherent) {
+        if (!this->scene.octree.empty()) {
+            this->_render_coherent(shader);
+        }
+        this->_lap(stage_raster);
+    } else if (type == rendering_method::octree ||
+               type == rendering_method::masked) {
+        if (this->use_occluders && !this->scene.octree.empty()) {
+            profm("occluders");
+            size_t budget = max_occluders;
+            this->occlusion.clear();
+            this->_draw_occluders(0, budget);
+        }
+        this->_lap(stage_setup);
+        if (!this->scene.octree.empty()) {
+            this->_render_with_octree(0, shader);
+        }
+        this->_lap(stage_raster);
+    } else if (type == rendering_method::tiled) {
+        this->_render_tiled(shader);
+    } else if (type == rendering_method::deferred) {
+        this->_render_deferred(shader);
+    } else if (type == rendering_method::scanline) {
+        this->_render_scanline(false, shader);
+    } else if (type == rendering_method::scanline_zpyramid) {
+        this->_render_scanline(true, shader);
     } else {
-        this->scene.to_viewspace(this->mvp, this->cam.gaze());
-        for (Triangle const &v : this->scene.primitives()) {
+        this->scene.to_viewspace(this->mvp, this->cam.gaze(),
+                                 this->counters);
+        this->_lap(stage_transform);
+        for (size_t k = 0; k < this->scene.nprimitives(); ++k) {
+            Triangle const v = this->scene.primitive(k);
             if (type == rendering_method::zpyramid) {
-                this->_draw_triangle_with_zpyramid(v);
+                this->_draw_triangle_with_zpyramid(v, shader);
             } else if (type == rendering_method::naive) {
-                this->_draw_triangle_with_aabb(v);
+                this->_draw_triangle_with_aabb(v, shader);
             } else {
                 errorm("Unhandled rendering method encountered\n");
             }
         }
+        this->_lap(stage_raster);
     }
 }
 
-// private:
 void Zbuf::_init() {
     this->cam_initialized      = false;
     this->mvp_initialized      = false;
     this->viewport_initialized = false;
     this->frag_shader          = nullptr;
+    this->shader               = shdr::custom;
+    this->img_resolved         = false;
+    this->use_occluders        = false;
+    this->stage_ms.fill(0);
+    this->counters.reset();
 }
 
-bool Zbuf::inside(flt x, flt y, Triangle const &t) const {
-    return t.contains(x, y);
+void Zbuf::_lap(render_stage const &s) {
+    this->stage_timer.end();
+    this->stage_ms[s] += this->stage_timer.elapsedms();
+    this->stage_timer.start();
+}
+
+void Zbuf::_clear_tile(size_t const &x, size_t const &y) const {
+    int    el = this->zpyramid.epoch_tile_level();
+    size_t x0 = x >> el << el, x1 = std::min(x0 + (size_t{1} << el), this->w);
+    size_t y0 = y >> el << el, y1 = std::min(y0 + (size_t{1} << el), this->h);
+    for (size_t j = y0; j < y1; ++j) {
+        std::fill(this->img.data.begin() + this->w * j + x0,
+                  this->img.data.begin() + this->w * j + x1, Color{0});
+    }
 }
 
 void Zbuf::set_pixel(size_t const &x, size_t const &y, Color const &color) {
     this->img(x, y) = color;
 }
 
-flt &Zbuf::z(size_t const &x, size_t const &y) {
+template <typename Shader>
+Color Zbuf::_shade(Shader const &shader, Triangle const &t, Triangle const &v,
+                   std::tuple<flt, flt, flt> const &barycentric) {
+    statm(this->counters, shaded, 1);
+    return shader(t, v, barycentric);
+}
+
+bool Zbuf::_visible(Triangle const &t, size_t const &x0, size_t const &y0,
+                    size_t const &x1, size_t const &y1) const {
+    int  level;
+    bool ret = this->zpyramid.visible(t, x0, y0, x1, y1, &level);
+    statm(this->counters, pyramid_tests, 1);
+    statm(this->counters, lca_levels, level);
+    statm(this->counters, pyramid_culled, !ret);
+    if (ret && this->use_occluders) {
+        ret = this->occlusion.visible(t);
+        statm(this->counters, occlusion_culled, !ret);
+    }
+    return ret;
+}
+
+bool Zbuf::_visible(size_t const &x0, size_t const &y0, size_t const &x1,
+                    size_t const &y1, flt const &nearest_z) const {
+    int  level;
+    bool ret = this->zpyramid.visible(x0, y0, x1, y1, nearest_z, &level);
+    statm(this->counters, pyramid_tests, 1);
+    statm(this->counters, lca_levels, level);
+    if (ret && this->use_occluders) {
+        ret = this->occlusion.visible(x0, y0, x1, y1, nearest_z);
+        statm(this->counters, occlusion_culled, !ret);
+    }
+    return ret;
+}
+
+bool Zbuf::_nearer(Raster const &r, int const &x0, int const &y0,
+                   int const &x1, int const &y1) const {
+    // Reciprocal depth is linear in screen space, so over the area it is
+    // extreme at corner pixel centers, and its reciprocal is too unless it
+    // changes sign.
+    flt xa = .5 + x0, xb = .5 + x1 - 1, ya = .5 + y0, yb = .5 + y1 - 1;
+    std::array<flt, 4> iz{r.iz(xa, ya), r.iz(xb, ya), r.iz(xa, yb),
+                          r.iz(xb, yb)};
+    flt farthest_z = std::numeric_limits<flt>::max();
+    for (flt const &v : iz) {
+        if (v * iz[0] <= 0) {
+            return false;
+        }
+        farthest_z = std::min(farthest_z, 1 / v);
+    }
+    return this->zpyramid.nearer(x0, y0, x1 - 1, y1 - 1, farthest_z);
+}
+
+depth_t &Zbuf::z(size_t const &x, size_t const &y) {
     return this->zpyramid(x, y);
 }
 
-flt const &Zbuf::z(size_t const &x, size_t const &y) const {
+depth_t const &Zbuf::z(size_t const &x, size_t const &y) const {
     return this->zpyramid(x, y);
 }
 
-void Zbuf::_draw_triangle_with_aabb(Triangle const &v) {
+template <typename Shader>
+void Zbuf::_draw_triangle_with_aabb(Triangle const &v, Shader const &shader) {
+    // Triangle with screen-space coordinates
+    Triangle t(v * viewport);
+    Raster   r(t, v);
+    if (r.degenerate()) {
+        return;
+    }
+    this->_raster(r, 0, 0, this->w, this->h, false, -1,
+                  [&](int const &x, int const &y, auto const &barycentric) {
+                      this->set_pixel(
+                          x, y, this->_shade(shader, t, v, barycentric));
+                  });
+}
+
+template <typename Shader>
+void Zbuf::_draw_triangle_with_zpyramid(Triangle const &v,
+                                        Shader const &shader) {
     // Triangle with screen-space coordinates
     Triangle t(v * viewport);
-    // AABB
-    int xmin = std::floor(std::min(t.a().x, std::min(t.b().x, t.c().x)));
-    int xmax = std::ceil(std::max(t.a().x, std::max(t.b().x, t.c().x)));
-    int ymin = std::floor(std::min(t.a().y, std::min(t.b().y, t.c().y)));
-    int ymax = std::ceil(std::max(t.a().y, std::max(t.b().y, t.c().y)));
-    xmin = clamp(xmin, 0, w - 1), xmax = clamp(xmax, 0, w - 1);
-    ymin = clamp(ymin, 0, h - 1), ymax = clamp(ymax, 0, h - 1);
-    for (int j = ymin; j < ymax; ++j) {
-        for (int i = xmin; i < xmax; ++i) {
-            // todo: AA
-            flt x = .5 + i;
-            flt y = .5 + j;
-            if (this->inside(x, y, t)) {
-                // Screen space barycentric coordinates of (x, y) inside
-                // triangle t.
-                std::tuple<flt, flt, flt> barycentric = t % vec3{x, y, 0};
-                // unpack the barycentric coordinates
-                auto [ca, cb, cc] = barycentric;
-                // z value in view-space
-                flt real_z = 1 / (ca / v.a().z + cb / v.b().z + cc / v.c().z);
-                if (real_z > this->z(i, j)) {
-                    // Calculate interpolated color with given triangle's 3
-                    // vertices.
-                    // Note: t and v shall have same color values by now.
-                    // Color icol    = v.color_at(ca, cb, cc, real_z);
-                    Color icol    = this->frag_shader(t, v, barycentric);
-                    this->z(i, j) = real_z;
-                    this->set_pixel(i, j, icol);
+    if (this->_visible(t, 0, 0, this->w, this->h)) {
+        Raster r(t, v);
+        if (r.degenerate()) {
+            return;
+        }
+        this->_raster(
+            r, 0, 0, this->w, this->h, true, -1,
+            [&](int const &x, int const &y, auto const &barycentric) {
+                this->set_pixel(x, y,
+                                this->_shade(shader, t, v, barycentric));
+            });
+    }
+}
+
+template <typename Fragment>
+void Zbuf::_raster(Raster const &r, int x0, int y0, int x1, int y1,
+                   bool const &hierarchical, int const &top,
+                   Fragment const &fragment) {
+    // Clamp the triangle's AABB to given area
+    x0 = std::max(x0, r.xmin), x1 = std::min(x1, r.xmax);
+    y0 = std::max(y0, r.ymin), y1 = std::min(y1, r.ymax);
+    // Pixels tested and passing the depth test, pixels accepted without
+    // tests, and texels updated by `setz`
+    uint64_t tested = 0, passed = 0, accepted = 0, steps = 0;
+    // Blocks are aligned to multiples of `raster_block` in screen space
+    int bx0 = x0 - x0 % raster_block;
+    int by0 = y0 - y0 % raster_block;
+    for (int by = by0; by < y1; by += raster_block) {
+        int jmin = std::max(by, y0), jmax = std::min(by + raster_block, y1);
+        for (int bx = bx0; bx < x1; bx += raster_block) {
+            int imin = std::max(bx, x0);
+            int imax = std::min(bx + raster_block, x1);
+            // Trivially reject blocks outside the triangle, and skip
+            // per-pixel edge tests for blocks inside the triangle.
+            coverage cov = r.classify(imin, jmin, imax, jmax);
+            if (cov == coverage::outside) {
+                continue;
+            }
+            // Lazily clear the block's epoch tile for current frame.
+            if (this->zpyramid.touch(imin, jmin)) {
+                this->_clear_tile(imin, jmin);
+            }
+            // Trivially accept blocks inside the triangle and nearer than
+            // everything drawn in them, their depth values are written
+            // without tests, and the pyramid is updated once per block.
+            // Testing blocks partially covered by small triangles costs more
+            // than the per-pixel tests it saves.
+            bool accept = hierarchical && cov == coverage::inside &&
+                          this->_nearer(r, imin, jmin, imax, jmax);
+            // Edge and reciprocal depth values at the block's first pixel
+            // center.
+            std::array<int64_t, 3> erow{r.edge(0, imin, jmin),
+                                        r.edge(1, imin, jmin),
+                                        r.edge(2, imin, jmin)};
+            flt izrow = r.iz(.5 + imin, .5 + jmin);
+            for (int j = jmin; j < jmax; ++j) {
+                std::array<int64_t, 3> e  = erow;
+                flt                    iz = izrow;
+                for (int i = imin; i < imax; ++i) {
+                    if (cov == coverage::inside ||
+                        (e[0] > 0 && e[1] > 0 && e[2] > 0)) {
+                        // z value in view-space
+                        depth_t real_z = this->zpyramid.encode(1 / iz);
+                        if (STATISTICS && !accept) {
+                            ++tested;
+                        }
+                        if (accept || real_z > this->z(i, j)) {
+                            // Screen space barycentric coordinates of the
+                            // pixel center inside triangle t.
+                            std::tuple<flt, flt, flt> barycentric{
+                                e[0] * r.inv_doublearea,
+                                e[1] * r.inv_doublearea,
+                                e[2] * r.inv_doublearea,
+                            };
+                            if (hierarchical && !accept) {
+                                int climbed =
+                                    this->zpyramid.setz(i, j, real_z, top);
+                                if (STATISTICS) {
+                                    steps += climbed;
+                                }
+                            } else {
+                                this->z(i, j) = real_z;
+                            }
+                            if (STATISTICS) {
+                                ++(accept ? accepted : passed);
+                            }
+                            fragment(i, j, barycentric);
+                        }
+                    }
+                    e[0] += r.a[0], e[1] += r.a[1], e[2] += r.a[2];
+                    iz += r.za;
+                }
+                erow[0] += r.b[0], erow[1] += r.b[1], erow[2] += r.b[2];
+                izrow += r.zb;
+            }
+            if (accept) {
+                int climbed =
+                    this->zpyramid.update(imin, jmin, imax, jmax, top);
+                if (STATISTICS) {
+                    steps += climbed;
                 }
             }
         }
     }
+    statm(this->counters, pixels_tested, tested);
+    statm(this->counters, pixels_passed, passed);
+    statm(this->counters, pixels_accepted, accepted);
+    statm(this->counters, setz_steps, steps);
 }
 
-void Zbuf::_draw_triangle_with_zpyramid(Triangle const &v) {
-    // Triangle with screen-space coordinates
-    Triangle t(v * viewport);
-    if (this->zpyramid.visible(t, nullptr)) {
+template <typename Shader>
+void Zbuf::_render_with_octree(uint32_t const &id, Shader const &shader) {
+    Node8 const &node = this->scene.octree[id];
+    statm(this->counters, nodes_visited, 1);
+    // When the cube does not intersect with the view frustum, or is hidden
+    // behind what has been drawn, the whole subtree can be safely ignored.
+    this->node_visible[id] = !this->_cull(node);
+    if (!this->node_visible[id]) {
+        statm(this->counters, nodes_culled, 1);
+        return;
+    }
+    // When the cube does intersect with the view frustum, render the
+    // triangles associated with it, and dive into its child nodes.
+    this->_draw_node(node, shader);
+    for (uint32_t const &child : this->_children(node)) {
+        if (child != Node8::none) {
+            this->_render_with_octree(child, shader);
+        }
+    }
+}
+
+template <typename Shader>
+void Zbuf::_render_coherent(Shader const &shader) {
+    std::vector<uint32_t> &queries = this->node_queries;
+    queries.clear();
+    {
+        profm("visible nodes");
+        this->_render_visible_nodes(0, shader);
+    }
+    profm("queries");
+    // Test all queried nodes against the depth buffer of previously
+    // visible geometry first, then render the ones found visible.
+    size_t n = 0;
+    for (uint32_t const &id : queries) {
+        statm(this->counters, nodes_visited, 1);
+        statm(this->counters, nodes_queried, 1);
+        if (this->_cull(this->scene.octree[id])) {
+            statm(this->counters, nodes_culled, 1);
+        } else {
+            queries[n++] = id;
+        }
+    }
+    queries.resize(n);
+    for (uint32_t const &id : queries) {
+        Node8 const &node      = this->scene.octree[id];
+        this->node_visible[id] = true;
+        this->_draw_node(node, shader);
+        for (uint32_t const &child : this->_children(node)) {
+            if (child != Node8::none) {
+                this->_render_with_octree(child, shader);
+            }
+        }
+    }
+}
+
+template <typename Shader>
+void Zbuf::_render_visible_nodes(uint32_t const &id, Shader const &shader) {
+    if (!this->node_visible[id]) {
+        this->node_queries.push_back(id);
+        return;
+    }
+    Node8 const &node = this->scene.octree[id];
+    statm(this->counters, nodes_visited, 1);
+    this->node_visible[id] = !this->_cull(node);
+    if (!this->node_visible[id]) {
+        statm(this->counters, nodes_culled, 1);
+        return;
+    }
+    this->_draw_node(node, shader);
+    for (uint32_t const &child : this->_children(node)) {
+        if (child != Node8::none) {
+            this->_render_visible_nodes(child, shader);
+        }
+    }
+}
+
+template <typename Shader>
+void Zbuf::_draw_node(Node8 const &node, Shader const &shader) {
+    std::span<Triangle const> prims = this->scene.triangles();
+    std::vector<Triangle>     clipped;
+    for (uint32_t i = node.first; i < node.first + node.count; ++i) {
+        Triangle const &t = prims[i];
+        // Face culling
+        if (glm::dot(this->cam.gaze(), t.facing) >= 0) {
+            statm(this->counters, facing_culled, 1);
+            continue;
+        }
+        // Convert to view space and clip
+        clipped.clear();
+        clip(t, this->mvp, clipped);
+        statm(this->counters, frustum_culled, clipped.empty());
+        for (Triangle const &v : clipped) {
+            this->_draw_triangle_with_zpyramid(v, shader);
+        }
+    }
+}
+
+std::array<uint32_t, 8> Zbuf::_children(Node8 const &node) const {
+    // Index of the nearest child has the same bit layout as `Node8::index`,
+    // the visiting order flips one, then two, then all three bits of it.
+    static constexpr std::array<size_t, 8> order{0, 1, 2, 4, 3, 5, 6, 7};
+    vec3 const &eye     = this->cam.pos();
+    size_t      nearest = (eye.x > node.midcord[0]) |
+                     (eye.y > node.midcord[1]) << 1 |
+                     (eye.z > node.midcord[2]) << 2;
+    std::array<uint32_t, 8> ret;
+    for (size_t i = 0; i < order.size(); ++i) {
+        ret[i] = node.children[nearest ^ order[i]];
+    }
+    return ret;
+}
+
+bool Zbuf::_cull(Node8 const &node) const {
+    BBox rect;
+    if (this->_project(node, rect)) {
+        return true;
+    }
+    if (rect.minp.x > rect.maxp.x) {
+        return false;
+    }
+    // Hi-Z test: a single texel of the z-pyramid covers the rectangle.
+    return !this->_visible(clamp(rect.minp.x, 0, this->w - 1),
+                           clamp(rect.minp.y, 0, this->h - 1),
+                           clamp(rect.maxp.x, 0, this->w - 1),
+                           clamp(rect.maxp.y, 0, this->h - 1), rect.maxp.z);
+}
+
+bool Zbuf::_project(Node8 const &node, BBox &rect) const {
+    // Clip-space coordinates of the cube's corners
+    std::array<vec4, 8> corners;
+    unsigned            codes = ~0u;
+    for (int i = 0; i < 8; ++i) {
+        vec3 corner{
+            i & 1 ? node.maxcord[0] : node.mincord[0],
+            i & 2 ? node.maxcord[1] : node.mincord[1],
+            i & 4 ? node.maxcord[2] : node.mincord[2],
+        };
+        corners[i] = to_clip(corner, this->mvp);
+        codes &= outcode(corners[i]);
+    }
+    // View frustum culling: the cube is invisible when all its corners lie
+    // outside the same plane of the frustum.
+    if (codes) {
+        return true;
+    }
+    // Screen-space rectangle and depth range of the cube.
+    rect = BBox{};
+    for (vec4 const &c : corners) {
+        if (c.w <= epsilon) {
+            // The cube reaches behind the camera and can not be projected.
+            rect = BBox{};
+            return false;
+        }
+        vec3 ndc{c.x / c.w, c.y / c.w, c.z / c.w};
+        rect |= vec3{(ndc.x + 1) * flt{.5} * this->w,
+                     (ndc.y + 1) * flt{.5} * this->h, ndc.z};
+    }
+    return false;
+}
+
+void Zbuf::_draw_occluders(uint32_t const &id, size_t &budget) {
+    Node8 const &node = this->scene.octree[id];
+    BBox         rect;
+    if (budget == 0 || this->_project(node, rect)) {
+        return;
+    }
+    // Cubes are loose bounds of their subtrees' triangles, no triangle in
+    // a small cube can be a large occluder on screen.  Cubes that can not
+    // be projected are near the camera, and recursed into.
+    if (rect.minp.x <= rect.maxp.x) {
+        flt dx = clamp(rect.maxp.x, 0, this->w) -
+                 clamp(rect.minp.x, 0, this->w);
+        flt dy = clamp(rect.maxp.y, 0, this->h) -
+                 clamp(rect.minp.y, 0, this->h);
+        if (dx * dy < occluder_area) {
+            return;
+        }
+    }
+    std::span<Triangle const> prims = this->scene.triangles();
+    std::vector<Triangle>     clipped;
+    for (uint32_t i = node.first; i < node.first + node.count; ++i) {
+        Triangle const &t = prims[i];
+        if (glm::dot(this->cam.gaze(), t.facing) >= 0) {
+            continue;
+        }
+        // Clipping never enlarges a triangle, skip small triangles before
+        // clipping them.
+        std::array<vec4, 3> c{to_clip(t.a(), this->mvp),
+                              to_clip(t.b(), this->mvp),
+                              to_clip(t.c(), this->mvp)};
+        if (c[0].w > epsilon && c[1].w > epsilon && c[2].w > epsilon) {
+            vec2 a{c[0].x / c[0].w, c[0].y / c[0].w};
+            vec2 ab = vec2{c[1].x / c[1].w, c[1].y / c[1].w} - a;
+            vec2 ac = vec2{c[2].x / c[2].w, c[2].y / c[2].w} - a;
+            // Half of the doubled area in NDC, scaled to pixels
+            flt area = std::fabs(ab.x * ac.y - ab.y * ac.x) * flt{.125} *
+                       this->w * this->h;
+            if (area < occluder_area) {
+                continue;
+            }
+        }
+        clipped.clear();
+        clip(t, c, clipped);
+        for (Triangle const &v : clipped) {
+            Raster r(v * viewport, v);
+            if (r.degenerate() || r.area() < occluder_area) {
+                continue;
+            }
+            this->occlusion.draw(r);
+            statm(this->counters, occluders, 1);
+            if (--budget == 0) {
+                return;
+            }
+        }
+    }
+    for (uint32_t const &child : this->_children(node)) {
+        if (child != Node8::none) {
+            this->_draw_occluders(child, budget);
+        }
+    }
+}
+
+void Zbuf::_init_tiles() {
+    this->tile_level = std::min(6, this->zpyramid.nlevels() - 1);
+    this->tile_cols  = this->zpyramid.width(this->tile_level);
+    this->tile_rows  = this->zpyramid.height(this->tile_level);
+    this->bins.assign(this->tile_cols * this->tile_rows,
+                      std::vector<uint32_t>{});
+    debugm("Screen split into %zux%zu tiles\n", this->tile_cols,
+           this->tile_rows);
+}
+
+void Zbuf::_assemble_triangles() {
+    size_t n = this->scene.nprimitives();
+    this->view_triangles.resize(n);
+    this->screen_triangles.resize(n);
+#pragma omp parallel for
+    for (size_t i = 0; i < n; ++i) {
+        this->view_triangles[i]   = this->scene.primitive(i);
+        this->screen_triangles[i] = this->view_triangles[i] * this->viewport;
+    }
+}
+
+template <typename Shader> void Zbuf::_render_tiled(Shader const &shader) {
+    this->scene.to_viewspace(this->mvp, this->cam.gaze(), this->counters);
+    this->_lap(stage_transform);
+
+    // Front end
+    this->_assemble_triangles();
+    for (auto &bin : this->bins) {
+        bin.clear();
+    }
+    int const &l = this->tile_level;
+    for (uint32_t i = 0; i < this->screen_triangles.size(); ++i) {
+        Triangle const &t = this->screen_triangles[i];
         // AABB
         int xmin = std::floor(std::min(t.a().x, std::min(t.b().x, t.c().x)));
         int xmax = std::ceil(std::max(t.a().x, std::max(t.b().x, t.c().x)));
         int ymin = std::floor(std::min(t.a().y, std::min(t.b().y, t.c().y)));
         int ymax = std::ceil(std::max(t.a().y, std::max(t.b().y, t.c().y)));
-        xmin = clamp(xmin, 0, w), xmax = clamp(xmax, 0, w);
-        ymin = clamp(ymin, 0, h), ymax = clamp(ymax, 0, h);
-        for (int j = ymin; j < ymax; ++j) {
-            for (int i = xmin; i < xmax; ++i) {
-                // todo: AA
-                flt x = .5 + i;
-                flt y = .5 + j;
-                if (this->inside(x, y, t)) {
-                    // Screen space barycentric coordinates of (x, y) inside
-                    // triangle t.
-                    std::tuple<flt, flt, flt> barycentric = t % vec3{x, y, 0};
-                    // unpack the barycentric coordinates
-                    auto [ca, cb, cc] = barycentric;
-                    // z value in view-space
-                    flt real_z =
-                        1 / (ca / v.a().z + cb / v.b().z + cc / v.c().z);
-                    if (real_z > this->z(i, j)) {
-                        // Calculate interpolated color with given triangle's
-                        // 3 vertices. Note: t and v shall have same color
-                        // values by now. Color icol    = v.color_at(ca, cb,
-                        // cc, real_z);
-                        Color icol = this->frag_shader(t, v, barycentric);
-                        this->zpyramid.setz(i, j, real_z);
-                        this->set_pixel(i, j, icol);
-                    }
-                }
+        if (xmax <= 0 || ymax <= 0 || xmin >= static_cast<int>(this->w) ||
+            ymin >= static_cast<int>(this->h)) {
+            continue;
+        }
+        xmin = clamp(xmin, 0, w - 1), xmax = clamp(xmax - 1, 0, w - 1);
+        ymin = clamp(ymin, 0, h - 1), ymax = clamp(ymax - 1, 0, h - 1);
+        // Tile columns and rows that the AABB overlaps
+        for (int r = ymin >> l; r <= (ymax >> l); ++r) {
+            for (int c = xmin >> l; c <= (xmax >> l); ++c) {
+                this->bins[static_cast<size_t>(r) * this->tile_cols + c]
+                    .push_back(i);
             }
         }
     }
+    this->_lap(stage_setup);
+
+    // Back end
+#pragma omp parallel for schedule(dynamic)
+    for (size_t b = 0; b < this->bins.size(); ++b) {
+        profm("tile");
+        size_t tx = b % this->tile_cols, ty = b / this->tile_cols;
+        for (uint32_t const &i : this->bins[b]) {
+            this->_draw_triangle_in_tile(this->screen_triangles[i],
+                                         this->view_triangles[i], tx, ty,
+                                         shader);
+        }
+    }
+    // Tiles only updated levels up to `tile_level`, update the rest of the
+    // pyramid.
+    this->zpyramid.refresh(this->tile_level);
+    this->_lap(stage_raster);
 }
 
-void Zbuf::_render_with_octree(Node8 const *node) {
-    std::vector<Triangle> facets;
-    // Convert to view space coordinates
-    for (int i = 0; i < 12; ++i) {
-        // Face culling
-        if (glm::dot(this->cam.gaze(), node->facets[i].facing) >= 0) {
+template <typename Shader>
+void Zbuf::_draw_triangle_in_tile(Triangle const &t, Triangle const &v,
+                                  size_t const &tx, size_t const &ty,
+                                  Shader const &shader) {
+    int const &l  = this->tile_level;
+    size_t     x0 = tx << l, x1 = std::min((tx + 1) << l, this->w);
+    size_t     y0 = ty << l, y1 = std::min((ty + 1) << l, this->h);
+    if (!this->_visible(t, x0, y0, x1, y1)) {
+        return;
+    }
+    Raster r(t, v);
+    if (r.degenerate()) {
+        return;
+    }
+    this->_raster(r, x0, y0, x1, y1, true, l,
+                  [&](int const &x, int const &y, auto const &barycentric) {
+                      this->set_pixel(
+                          x, y, this->_shade(shader, t, v, barycentric));
+                  });
+}
+
+template <typename Shader>
+void Zbuf::_render_scanline(bool const &hierarchical, Shader const &shader) {
+    this->scene.to_viewspace(this->mvp, this->cam.gaze(), this->counters);
+    this->_lap(stage_transform);
+
+    this->_assemble_triangles();
+    // Polygon table
+    for (auto &bucket : this->polygon_table) {
+        bucket.clear();
+    }
+    for (uint32_t i = 0; i < this->screen_triangles.size(); ++i) {
+        Triangle const &t = this->screen_triangles[i];
+        int xmin = std::floor(std::min(t.a().x, std::min(t.b().x, t.c().x)));
+        int xmax = std::ceil(std::max(t.a().x, std::max(t.b().x, t.c().x)));
+        int ymin = std::floor(std::min(t.a().y, std::min(t.b().y, t.c().y)));
+        int ymax = std::ceil(std::max(t.a().y, std::max(t.b().y, t.c().y)));
+        if (xmax <= 0 || ymax <= 0 || xmin >= static_cast<int>(this->w) ||
+            ymin >= static_cast<int>(this->h)) {
             continue;
         }
-        facets.push_back(node->facets[i] * mvp);
-    }
-    // Check if this cube intersects with the view frustum (view frustum
-    // culling)
-    // Note: this is not deterministic but quite enough
-    bool invisible{true};
-    for (auto const &v : facets) {
-        for (int i = 0; i < 3; ++i) {
-            if (v.vert_in_canonical()) {
-                invisible = false;
-                break;
+        this->polygon_table[std::max(ymin, 0)].push_back(i);
+    }
+    this->_lap(stage_setup);
+
+    // Active triangles, sorted by their indices so that every pixel sees
+    // triangles in the same order as other rendering methods do.
+    std::vector<ActiveTriangle> active;
+    int const w = this->w, h = this->h;
+    for (int y = 0; y < h; ++y) {
+        // Retire triangles that are done, activate triangles that start
+        // from current scanline.
+        active.erase(std::remove_if(active.begin(), active.end(),
+                                    [&](ActiveTriangle const &a) {
+                                        return a.r.ymax <= y;
+                                    }),
+                     active.end());
+        size_t n = active.size();
+        for (uint32_t const &i : this->polygon_table[y]) {
+            ActiveTriangle a(i, this->screen_triangles[i],
+                             this->view_triangles[i], y);
+            if (!a.r.degenerate()) {
+                active.push_back(a);
+            }
+        }
+        std::inplace_merge(
+            active.begin(), active.begin() + n, active.end(),
+            [](ActiveTriangle const &a, ActiveTriangle const &b) {
+                return a.id < b.id;
+            });
+
+        for (ActiveTriangle &a : active) {
+            Triangle const &t = this->screen_triangles[a.id];
+            Triangle const &v = this->view_triangles[a.id];
+            int             x0, x1;
+            a.span(clamp(a.r.xmin, 0, w), clamp(a.r.xmax, 0, w), x0, x1);
+            a.next();
+            if (!hierarchical) {
+                this->_draw_span(t, v, a.r, y, x0, x1, false, shader);
+                continue;
+            }
+            // Split the span into aligned runs of 2^k pixels, each run lies
+            // in a single texel of level k, whose farthest depth bounds the
+            // run's depth interval from behind.  Consecutive visible runs
+            // are drawn as one span.  Runs shorter than 2^scanline_run_level
+            // pixels are not worth testing, and are always drawn.
+            int from = x0;
+            for (int x = x0; x < x1;) {
+                unsigned ux = x, len = x1 - x;
+                int      k  = std::min(std::countr_zero(ux),
+                                 static_cast<int>(std::bit_width(len)) - 1);
+                int last = x + (1 << k) - 1;
+                // Reciprocal depth is linear along the span, its reciprocal
+                // is monotonic unless it changes sign in the run.
+                flt izl = a.r.iz(.5 + x, .5 + y);
+                flt izr = a.r.iz(.5 + last, .5 + y);
+                flt nearest_z = izl * izr > 0
+                                    ? std::max(1 / izl, 1 / izr)
+                                    : std::numeric_limits<flt>::max();
+                if (k >= scanline_run_level &&
+                    !this->_visible(x, y, last, y, nearest_z)) {
+                    this->_draw_span(t, v, a.r, y, from, x, true, shader);
+                    from = last + 1;
+                }
+                x = last + 1;
             }
+            this->_draw_span(t, v, a.r, y, from, x1, true, shader);
         }
     }
-    // When the cube does not intersects with the view frustum, it can be
-    // safely ignored.
-    if (invisible) {
+    this->_lap(stage_raster);
+}
+
+template <typename Shader>
+void Zbuf::_draw_span(Triangle const &t, Triangle const &v, Raster const &r,
+                      int const &y, int const &x0, int const &x1,
+                      bool const &hierarchical, Shader const &shader) {
+    if (x0 >= x1) {
         return;
     }
-    // When the cube does intersect with the view frustum, render the
-    // triangles associated with it, and dive into its child nodes.
-    for (Triangle const &t : node->prims) {
-        // Face culling
-        if (glm::dot(this->cam.gaze(), t.facing) >= 0) {
-            continue;
+    int const n = 1 << this->zpyramid.epoch_tile_level();
+    // Edge and reciprocal depth values at the span's first pixel center.
+    std::array<int64_t, 3> e{r.edge(0, x0, y), r.edge(1, x0, y),
+                             r.edge(2, x0, y)};
+    flt                    iz     = r.iz(.5 + x0, .5 + y);
+    uint64_t               passed = 0, steps = 0;
+    for (int x = x0; x < x1; ++x) {
+        // Lazily clear epoch tiles the span enters.
+        if ((x == x0 || x % n == 0) && this->zpyramid.touch(x, y)) {
+            this->_clear_tile(x, y);
         }
-        // Convert to view space
-        Triangle v = t * this->mvp;
-        // View frustum culling
-        for (int i = 0; i < 3; ++i) {
-            if (v.vert_in_canonical()) {
-                this->_draw_triangle_with_zpyramid(v);
-                break;
+        // z value in view-space
+        depth_t real_z = this->zpyramid.encode(1 / iz);
+        if (real_z > this->z(x, y)) {
+            std::tuple<flt, flt, flt> barycentric{
+                e[0] * r.inv_doublearea,
+                e[1] * r.inv_doublearea,
+                e[2] * r.inv_doublearea,
+            };
+            Color icol = this->_shade(shader, t, v, barycentric);
+            if (hierarchical) {
+                int climbed = this->zpyramid.setz(x, y, real_z);
+                if (STATISTICS) {
+                    steps += climbed;
+                }
+            } else {
+                this->z(x, y) = real_z;
             }
+            if (STATISTICS) {
+                ++passed;
+            }
+            this->set_pixel(x, y, icol);
         }
+        e[0] += r.a[0], e[1] += r.a[1], e[2] += r.a[2];
+        iz += r.za;
     }
-    // Recurse into child nodes.
-    for (Node8 *child : node->children) {
-        if (child == nullptr) {
+    statm(this->counters, pixels_tested, x1 - x0);
+    statm(this->counters, pixels_passed, passed);
+    statm(this->counters, setz_steps, steps);
+}
+
+template <typename Shader>
+void Zbuf::_render_deferred(Shader const &shader) {
+    this->scene.to_viewspace(this->mvp, this->cam.gaze(), this->counters);
+    this->_lap(stage_transform);
+
+    // Raster pass
+    for (uint32_t i = 0; i < this->scene.nprimitives(); ++i) {
+        Triangle const v = this->scene.primitive(i);
+        Triangle       t(v * this->viewport);
+        if (!this->_visible(t, 0, 0, this->w, this->h)) {
             continue;
         }
-        this->_render_with_octree(child);
+        Raster r(t, v);
+        if (r.degenerate()) {
+            continue;
+        }
+        this->_raster(
+            r, 0, 0, this->w, this->h, true, -1,
+            [&](int const &x, int const &y, auto const &barycentric) {
+                this->vis_ids(x, y)          = i;
+                this->vis_barycentrics(x, y) = {
+                    std::get<0>(barycentric),
+                    std::get<1>(barycentric),
+                };
+            });
+    }
+
+    this->_lap(stage_raster);
+
+    // Resolve pass
+    int const w = this->w, h = this->h;
+#pragma omp parallel for schedule(dynamic)
+    for (int y = 0; y < h; ++y) {
+        // Neighboring pixels mostly show the same triangle, keep the last
+        // view-space and screen-space triangles around.
+        uint32_t last = std::numeric_limits<uint32_t>::max();
+        Triangle v, t;
+        for (int x = 0; x < w; ++x) {
+            // Pixels in stale epoch tiles, or not covered by any triangle
+            if (this->zpyramid.at(0, x, y) == Pyramid::farthest) {
+                continue;
+            }
+            uint32_t const &i = this->vis_ids(x, y);
+            if (i != last) {
+                v    = this->scene.primitive(i);
+                t    = v * this->viewport;
+                last = i;
+            }
+            std::array<flt, 2> const &b = this->vis_barycentrics(x, y);
+            this->set_pixel(x, y,
+                            this->_shade(shader, t, v,
+                                         {b[0], b[1], 1 - b[0] - b[1]}));
+        }
     }
+    this->_lap(stage_resolve);
 }
 
 // Author: Blurgy <gy@blurgy.xyz>
@@ -3,16 +3,46 @@
 #include <functional>
 
 #include "Camera.hpp"
+#include "Occlusion.hpp"
 #include "Pyramid.hpp"
+#include "Raster.hpp"
 #include "Scene.hpp"
+#include "Stats.hpp"
+#include "Timer.hpp"
 #include "global.hpp"
+#include "shaders.hpp"
 
 #include <glm/ext/matrix_transform.hpp>
 
 enum rendering_method {
-    naive,    // render with AABB of each triangle
-    zpyramid, // render with z-pyramid only
-    octree,   // render with z-pyramid + octree
+    naive,             // render with AABB of each triangle
+    zpyramid,          // render with z-pyramid only
+    octree,            // render with z-pyramid + octree
+    tiled,             // render with z-pyramid, triangles are binned into
+                       // screen tiles and tiles are rasterized in parallel
+    deferred,          // render with z-pyramid, rasterize into a visibility
+                       // buffer first, then shade each visible pixel once
+    scanline,          // render scanline by scanline, with an active
+                       // triangle list
+    scanline_zpyramid, // render scanline by scanline, occluded parts of
+                       // spans are skipped with z-pyramid
+    masked,            // render with z-pyramid + octree, after drawing large
+                       // occluders into a masked depth buffer
+    coherent,          // render with z-pyramid + octree, nodes visible in
+                       // last frame first, then test the others in a batch
+};
+
+// Stages of a frame, timed separately by `Zbuf::render`.  Stages a method
+// does not have take no time, e.g. the octree method culls, transforms and
+// rasterizes node by node, all of which is accounted as rasterization,
+// while its occluder pre-pass is accounted as setup.
+enum render_stage {
+    stage_transform, // vertex transform, face culling and clipping
+    stage_setup,     // screen-space setup: binning, polygon table,
+                     // occluders
+    stage_raster,    // rasterization, including shading in forward methods
+    stage_resolve,   // shading pass of deferred rendering
+    nstages,
 };
 
 class Zbuf {
@@ -40,17 +70,75 @@ class Zbuf {
 
     // Depth buffer
     Pyramid zpyramid;
-    // Color buffer
-    Image img;
+    // Color buffer, cleared lazily with the epoch tiles of `zpyramid`:
+    // an epoch tile's color is cleared when the tile is first touched in a
+    // frame, tiles untouched in a frame are cleared when the image is
+    // requested.
+    mutable Image img;
+    // Whether stale tiles in `img` have been cleared for current frame
+    mutable bool img_resolved;
 
     std::function<void(Triangle const &)> method;
 
+    // Screen tiles are texels of level `tile_level` in `zpyramid`, i.e.
+    // squares of (1 << tile_level) pixels.  When rendering with
+    // `rendering_method::tiled`, each tile is owned by exactly one thread,
+    // together with its part of the color buffer and the depth texels below
+    // it, so that no lock is needed on the depth and color buffers.
+    int tile_level;
+    // Number of tile columns and rows
+    size_t tile_cols, tile_rows;
+    // Indices of screen-space triangles overlapping each tile
+    std::vector<std::vector<uint32_t>> bins;
+    // View-space triangles to be drawn in current frame, assembled by
+    // `Scene::primitive()`, and their screen-space counterparts, shared by
+    // all tiles
+    std::vector<Triangle> view_triangles, screen_triangles;
+
+    // Visibility buffer of deferred rendering, index of the nearest triangle
+    // and its barycentric coordinates at each pixel.  Only the first two
+    // barycentric coordinates are stored, the third one is derived from
+    // them.  Both buffers share epoch tiles of `zpyramid`, pixels are
+    // covered iff their depth is not infinitely far.
+    Image_t<uint32_t>           vis_ids;
+    Image_t<std::array<flt, 2>> vis_barycentrics;
+
+    // Polygon table of the scanline rasterizer: indices of screen-space
+    // triangles, bucketed by the first scanline they cover
+    std::vector<std::vector<uint32_t>> polygon_table;
+
+    // Coarse depth buffer of large occluders, drawn before the octree is
+    // rendered with `rendering_method::masked`
+    OcclusionBuffer occlusion;
+    // Whether octree nodes and triangles are tested against `occlusion` in
+    // current frame
+    bool use_occluders;
+
+    // Whether each octree node was visible, i.e. not culled, when last
+    // rendered with the octree.  Nodes not reached in a frame keep their
+    // values.  Visibility is kept across frames, so that
+    // `rendering_method::coherent` can draw the previously visible nodes
+    // first.
+    std::vector<uint8_t> node_visible;
+    // Nodes invisible in last frame, reached in current frame by
+    // `rendering_method::coherent`, in front-to-back order
+    std::vector<uint32_t> node_queries;
+
+    // Time spent in each stage of last frame, in milliseconds
+    std::array<flt, nstages> stage_ms;
+    Timer                    stage_timer;
+    // Per-thread culling and overdraw counters of last frame, only counted
+    // when compiled with `ZBUF_STATS`
+    mutable StatsCounter counters;
+
   private:
     // Set default values
     void _init();
-    // Check if screen space coordinate (x, y) is inside the triangle t,
-    // coordinates of vertices of triangle t should be in screen space, too.
-    bool inside(flt x, flt y, Triangle const &t) const;
+    // Account time since last lap (or since the frame started) to stage
+    // `s`.
+    void _lap(render_stage const &s);
+    // Clear color of the epoch tile containing image coordinate (x, y).
+    void _clear_tile(size_t const &x, size_t const &y) const;
     // Set image pixel at coordinate (x, y), origin is located at left-bottom
     // corner of the image.
     void set_pixel(size_t const &x, size_t const &y,
@@ -61,28 +149,162 @@ class Zbuf {
     std::function<Color(Triangle const &t, Triangle const &v,
                         std::tuple<flt, flt, flt> const &barycentric)>
         frag_shader;
+    // Registered shader wrapped in `frag_shader`, rasterizers are
+    // instantiated for each registered shader and picked by this id when
+    // rendering, `frag_shader` itself is called for custom shaders.
+    shdr::shader_id shader;
+    // Call `shader` on a fragment and count the invocation.
+    template <typename Shader>
+    Color _shade(Shader const &shader, Triangle const &t, Triangle const &v,
+                 std::tuple<flt, flt, flt> const &barycentric);
+    // Test triangle `t` (with **screen-space** coordinates) against
+    // `zpyramid`, inside image area [x0, x1) x [y0, y1), see
+    // `Pyramid::visible`, then against `occlusion` if `use_occluders`.
+    // Counts the test, and the triangle if culled.
+    bool _visible(Triangle const &t, size_t const &x0, size_t const &y0,
+                  size_t const &x1, size_t const &y1) const;
+    // Test image area [x0, x1] x [y0, y1] (all INclusive) against
+    // `zpyramid`, see `Pyramid::visible`, then against `occlusion` if
+    // `use_occluders`.  Counts the test.
+    bool _visible(size_t const &x0, size_t const &y0, size_t const &x1,
+                  size_t const &y1, flt const &nearest_z) const;
+    // Whether every pixel of image area [x0, x1) x [y0, y1) that is covered
+    // by the triangle set up in `r` passes the depth test, see
+    // `Pyramid::nearer`.
+    bool _nearer(Raster const &r, int const &x0, int const &y0,
+                 int const &x1, int const &y1) const;
+    // Render scene with a rasterizer instantiated for `shader`.
+    // @param shader: `frag_shader`, or the function object of the same
+    //                registered shader
+    template <typename Shader>
+    void _render(rendering_method const &type, Shader const &shader);
+    // Rasterize a triangle inside screen area [x0, x1) x [y0, y1).  Edge
+    // equations from the setup stage `r` are stepped incrementally across
+    // blocks of `raster_block`x`raster_block` pixels, blocks outside the
+    // triangle are rejected as a whole, and blocks inside the triangle skip
+    // per-pixel edge tests.  Depth values of pixels passing the depth test
+    // are written, then `fragment(x, y, barycentric)` is called on them.
+    // When `hierarchical`, blocks inside the triangle and nearer than
+    // everything drawn in them skip per-pixel depth tests, and update
+    // `zpyramid` once instead of per pixel.
+    // @param hierarchical: Whether to propagate depth values in `zpyramid`,
+    //                      up to level `top` (the topmost if negative)
+    template <typename Fragment>
+    void _raster(Raster const &r, int x0, int y0, int x1, int y1,
+                 bool const &hierarchical, int const &top,
+                 Fragment const &fragment);
     // Naive z-buffer implementation.
     // @param v: Triangle with **viewspace** coordinates
-    void _draw_triangle_with_aabb(Triangle const &v);
+    template <typename Shader>
+    void _draw_triangle_with_aabb(Triangle const &v, Shader const &shader);
     // Use hierarchical z-buffer (depth MIP-map) to achieve ``early reject''.
     // @brief: Compare the triangle's nearest z value with the smallest
-    //         QuadTree node's depth value, if the triangle's nearest z value
-    //         is farther than current node's depth value, then this triangle
+    //         MIP-map texel's depth value, if the triangle's nearest z value
+    //         is farther than current texel's depth value, then this triangle
     //         can be safely ignored.
     //         If the triangle is not ignored, draw it with aabb.
-    //         (todo: scan conversion).
     // @param v: Triangle with **viewspace** coordinates
-    void _draw_triangle_with_zpyramid(Triangle const &v);
+    template <typename Shader>
+    void _draw_triangle_with_zpyramid(Triangle const &v,
+                                      Shader const &shader);
     // Depth buffer value at image coordinate (x, y), origin is located at
     // left-bottom corner of the image.
-    flt &      z(size_t const &x, size_t const &y);
-    flt const &z(size_t const &x, size_t const &y) const;
-    // Recurse octree from give node address, convert coordinates and render
-    // on the fly.
-    void _render_with_octree(Node8 const *node);
+    depth_t &      z(size_t const &x, size_t const &y);
+    depth_t const &z(size_t const &x, size_t const &y) const;
+    // Recurse octree from given node index, convert coordinates and render
+    // on the fly.  Children are visited front-to-back, i.e. starting from
+    // the child in the camera's octant relative to the node's splitting
+    // point, so that near geometry fills the z-pyramid before far geometry
+    // is tested against it.  Visibility of the nodes reached is recorded in
+    // `node_visible`.
+    template <typename Shader>
+    void _render_with_octree(uint32_t const &id, Shader const &shader);
+    // Coherent hierarchical culling, after CHC++ (Mattausch et al., 2008).
+    // Nodes visible in last frame are rendered first, and fill the
+    // z-pyramid with likely occluders.  Previously invisible nodes reached
+    // in the meantime are not descended into but queued, then tested
+    // against the z-pyramid in a batch, and the subtrees of those found
+    // visible are rendered as with `_render_with_octree`.  Every node
+    // drawn passes the same conservative tests as with the octree method,
+    // so stale visibility only affects speed, never the image.
+    template <typename Shader> void _render_coherent(Shader const &shader);
+    // First pass of `_render_coherent`: recurse octree from given node
+    // index, front to back, through nodes visible in last frame, queueing
+    // the invisible ones in `node_queries`.
+    template <typename Shader>
+    void _render_visible_nodes(uint32_t const &id, Shader const &shader);
+    // Draw the triangles associated with an octree node, not including its
+    // child nodes.
+    template <typename Shader>
+    void _draw_node(Node8 const &node, Shader const &shader);
+    // Child node indices of an octree node, from near to far, i.e. starting
+    // from the child in the camera's octant relative to the node's
+    // splitting point.  Nonexistent children are `Node8::none`.
+    std::array<uint32_t, 8> _children(Node8 const &node) const;
+    // Returns whether an octree node can be skipped, i.e. its cube lies
+    // outside the view frustum, or its projected screen rectangle is
+    // entirely behind the texel of `zpyramid` that covers it.
+    bool _cull(Node8 const &node) const;
+    // Project an octree node's cube onto the screen.  Returns whether the
+    // cube lies outside the view frustum.  Otherwise `rect` is set to the
+    // screen-space rectangle of the cube, with its farthest and nearest
+    // depth values as the z coordinates of `rect.minp` and `rect.maxp`, or
+    // left empty when the cube reaches behind the camera.
+    bool _project(Node8 const &node, BBox &rect) const;
+    // Occluder pre-pass: recurse octree from given node index front to
+    // back, and draw triangles covering at least `occluder_area` pixels
+    // into `occlusion`, until `budget` occluders are drawn.  Subtrees whose
+    // projected cube is smaller than that are skipped.
+    void _draw_occluders(uint32_t const &id, size_t &budget);
+    // Split the screen into tiles, using texels of `zpyramid` at level
+    // `tile_level`.
+    void _init_tiles();
+    // Assemble view-space triangles of current frame into `view_triangles`,
+    // and transform them into `screen_triangles`.
+    void _assemble_triangles();
+    // Binning front end: transform triangles into screen space, and sort
+    // them into bins of all tiles their AABB overlap.  Back end: rasterize
+    // tiles in parallel, each thread owns whole tiles.
+    template <typename Shader> void _render_tiled(Shader const &shader);
+    // Draw the part of triangle `t` that falls inside tile (tx, ty), depth
+    // values are propagated up to level `tile_level` only.
+    // @param t: Triangle with **screen-space** coordinates
+    // @param v: Triangle with **viewspace** coordinates
+    template <typename Shader>
+    void _draw_triangle_in_tile(Triangle const &t, Triangle const &v,
+                                size_t const &tx, size_t const &ty,
+                                Shader const &shader);
+    // Scanline z-buffer.  Triangles are sorted into `polygon_table` by
+    // their first scanline, scanlines are processed from bottom to top,
+    // keeping a list of active triangles that cover current scanline, whose
+    // spans are stepped incrementally.
+    // @param hierarchical: Whether to skip occluded parts of spans with
+    //                      `zpyramid`, in the manner of an interval
+    //                      z-buffer.  Depth values are propagated in
+    //                      `zpyramid` if set.
+    template <typename Shader>
+    void _render_scanline(bool const &hierarchical, Shader const &shader);
+    // Draw pixels [x0, x1) of scanline y, with depth values and barycentric
+    // coordinates stepped incrementally across the span.
+    // @param t: Triangle with **screen-space** coordinates
+    // @param v: Triangle with **viewspace** coordinates
+    template <typename Shader>
+    void _draw_span(Triangle const &t, Triangle const &v, Raster const &r,
+                    int const &y, int const &x0, int const &x1,
+                    bool const &hierarchical, Shader const &shader);
+    // Deferred shading.  The raster pass culls triangles with `zpyramid`
+    // and writes only depth values and the visibility buffer, the resolve
+    // pass then calls `shader` exactly once on each covered pixel, with
+    // rows resolved in parallel.
+    template <typename Shader> void _render_deferred(Shader const &shader);
 
   public:
     Image const &image() const;
+    // Time spent in each stage by last call to `render`, in milliseconds.
+    std::array<flt, nstages> const &stage_times() const;
+    // Culling and overdraw counters of last call to `render`, all zeros
+    // unless compiled with `ZBUF_STATS`.
+    RenderStats frame_stats() const;
 
   public:
     Zbuf();
@@ -95,6 +317,8 @@ class Zbuf {
     // function:
     //      1. Clears color buffer `this->img`;
     //      2. Clears depth buffer `this->Pyramid`;
+    // Both buffers are cleared in O(1) time by starting a new frame in
+    // `zpyramid`, see `Pyramid::clear()`.
     void reset();
 
     // Set fragment shader
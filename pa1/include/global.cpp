@@ -1,7 +1,10 @@
 #include "global.hpp"
+#include "Profiler.hpp"
 
+#include <algorithm>
 #include <cassert>
-#include <fstream>
+#include <cstdio>
+#include <cstring>
 
 // Constants
 flt const pi      = std::acos(-1.0);
@@ -97,29 +100,83 @@ BBox BBox::operator|=(vec3 const &rhs) {
     return *this;
 }
 
+// Write `len` bytes at `data` to file `filename` with a single call.
+static bool write_file(std::string const &filename, void const *data,
+                       size_t const &len) {
+    std::FILE *f = std::fopen(filename.c_str(), "wb");
+    if (f == nullptr) {
+        return false;
+    }
+    bool ok = std::fwrite(data, 1, len, f) == len;
+    return std::fclose(f) == 0 && ok;
+}
+
 void write_ppm(std::string const &filename, Image const &img,
                flt const &gamma) {
+    profm("write ppm");
     debugm("Writing image (%zux%zu) to %s ..\n", img.w, img.h,
            filename.c_str());
-    std::ofstream f(filename, std::ios_base::out | std::ios_base::binary);
-    char          ppm_head[50] = {0};
-    int           height       = img.h;
-    int           width        = img.w;
+    // Gamma correction of every channel value.  `Color::correction`
+    // treats channels independently, so one table serves all channels.
+    std::array<unsigned char, 256> lut;
+    for (int v = 0; v < 256; ++v) {
+        lut[v] = Color(static_cast<unsigned char>(v)).correction(gamma).r;
+    }
     // Magic number (P6), width, height, maximum color value,
     // seperated with whitespaces.
-    sprintf(ppm_head, "P6\n%d %d\n255\n", width, height);
-    f << ppm_head;
-
+    char ppm_head[50] = {0};
+    int  headlen      = snprintf(ppm_head, sizeof(ppm_head),
+                                 "P6\n%zu %zu\n255\n", img.w, img.h);
+    // The whole file is assembled in memory, rows are flipped since the ppm
+    // format lists rows from top to bottom.
+    std::vector<unsigned char> buf(headlen + 3 * img.w * img.h);
+    std::copy(ppm_head, ppm_head + headlen, buf.begin());
+#pragma omp parallel for
     for (size_t j = 0; j < img.h; ++j) {
+        unsigned char *row = buf.data() + headlen + 3 * img.w * j;
+        Color const *  src = &img(0, img.h - 1 - j);
         for (size_t i = 0; i < img.w; ++i) {
-            Color const &col = img(i, img.h - 1 - j).correction(gamma);
-            f << (char)(col.r) << (char)(col.g) << (char)(col.b);
+            row[3 * i + 0] = lut[src[i].r];
+            row[3 * i + 1] = lut[src[i].g];
+            row[3 * i + 2] = lut[src[i].b];
         }
     }
-    f.close();
+    if (!write_file(filename, buf.data(), buf.size())) {
+        errorm("Failed to write image to %s\n", filename.c_str());
+    }
     msg("Render result (%zux%zu, gamma=%.2f) saved in %s\n", img.w, img.h,
         gamma, filename.c_str());
 }
 
+void write_pfm(std::string const &filename, Image_t<vec3> const &img) {
+    profm("write pfm");
+    debugm("Writing image (%zux%zu) to %s ..\n", img.w, img.h,
+           filename.c_str());
+    // Magic number (PF), width, height, and a negative scale for little
+    // endian data.
+    char pfm_head[50] = {0};
+    int  headlen      = snprintf(pfm_head, sizeof(pfm_head),
+                                 "PF\n%zu %zu\n-1.0\n", img.w, img.h);
+    // Rows of pfm files are listed from bottom to top, same as `Image_t`.
+    size_t                     npixels = img.w * img.h;
+    std::vector<unsigned char> buf(headlen + 3 * sizeof(float) * npixels);
+    std::copy(pfm_head, pfm_head + headlen, buf.begin());
+    unsigned char *data = buf.data() + headlen;
+#pragma omp parallel for
+    for (size_t k = 0; k < npixels; ++k) {
+        float const values[3]{
+            static_cast<float>(img.data[k].r),
+            static_cast<float>(img.data[k].g),
+            static_cast<float>(img.data[k].b),
+        };
+        std::memcpy(data + sizeof(values) * k, values, sizeof(values));
+    }
+    if (!write_file(filename, buf.data(), buf.size())) {
+        errorm("Failed to write image to %s\n", filename.c_str());
+    }
+    msg("Raw result (%zux%zu) saved in %s\n", img.w, img.h,
+        filename.c_str());
+}
+
 // Author: Blurgy <gy@blurgy.xyz>
 // Date:   Nov 18 2020, 17:41 [CST]
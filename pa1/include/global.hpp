@@ -37,8 +37,13 @@
         fflush(stdout);                                                      \
     } while (0)
 
-// Type definitions
-typedef double                             flt;
+// Type definitions.  `flt` is single precision when `FLT_SINGLE` is
+// defined, see `ZBUF_FLOAT` in pa1/CMakeLists.txt.
+#ifdef FLT_SINGLE
+typedef float flt;
+#else
+typedef double flt;
+#endif
 typedef glm::vec<2, flt, glm::defaultp>    vec2;
 typedef glm::vec<3, flt, glm::defaultp>    vec3;
 typedef glm::vec<4, flt, glm::defaultp>    vec4;
@@ -128,7 +133,7 @@ struct BBox {
     BBox(vec3 const &p1, vec3 const &p2);
 
     vec3 constexpr centroid() const {
-        return this->minp + (this->maxp - this->minp) * 0.5;
+        return this->minp + (this->maxp - this->minp) * flt{.5};
     }
     vec3 constexpr extent() const { return this->maxp - this->minp; }
     flt constexpr area() const {
@@ -159,6 +164,12 @@ struct BBox {
 void write_ppm(std::string const &filename, Image const &img,
                flt const &gamma = 0.6);
 
+// Write floating point image data to a pfm file, without any correction.
+// Reference: http://www.pauldebevec.com/Research/HDR/PFM/
+// @param filename: name of the pfm image file
+// @param img: image data, with RGB values in each pixel
+void write_pfm(std::string const &filename, Image_t<vec3> const &img);
+
 // Returns min(maxx, max(x, minx))
 template <typename T, typename T1, typename T2>
 T constexpr clamp(T const &x, T1 const &minx = 0, T2 const &maxx = 1) {
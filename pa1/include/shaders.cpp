@@ -1,20 +1,37 @@
 #include "shaders.hpp"
 
+#include <array>
+
 Color shdr::normal_shader(Triangle const &t, Triangle const &v,
                           std::tuple<flt, flt, flt> const &barycentric) {
-    Color ret(.5 + .5 * (v.facing.x + 1.0) * 255,
-              .5 + .5 * (v.facing.y + 1.0) * 255,
-              .5 + .5 * (v.facing.z + 1.0) * 255);
-    return ret;
+    return Normal{}(t, v, barycentric);
 }
 
 Color shdr::vertex_interpolation_shader(
     Triangle const &t, Triangle const &v,
     std::tuple<flt, flt, flt> const &barycentric) {
-    auto [ca, cb, cc] = barycentric;
-    flt   real_z      = 1 / (ca / v.a().z + cb / v.b().z + cc / v.c().z);
-    Color ret         = v.color_at(ca, cb, cc, real_z);
-    return ret;
+    return VertexInterpolation{}(t, v, barycentric);
+}
+
+// Registry of shader functions that have function object counterparts.
+using shader_ptr = Color (*)(Triangle const &, Triangle const &,
+                             std::tuple<flt, flt, flt> const &);
+static std::array<std::pair<shader_ptr, shdr::shader_id>, 2> const registry{{
+    {shdr::normal_shader, shdr::normal},
+    {shdr::vertex_interpolation_shader, shdr::vertex_interpolation},
+}};
+
+shdr::shader_id shdr::lookup(Shader const &shader) {
+    shader_ptr const *target = shader.target<shader_ptr>();
+    if (target == nullptr) {
+        return shader_id::custom;
+    }
+    for (auto const &[func, id] : registry) {
+        if (*target == func) {
+            return id;
+        }
+    }
+    return shader_id::custom;
 }
 
 // Author: Blurgy <gy@blurgy.xyz>
@@ -3,8 +3,43 @@
 #include "Triangle.hpp"
 #include "global.hpp"
 
+#include <functional>
+
 namespace shdr {
 
+// Signature of fragment shaders.  Triangle t has screen coordinates,
+// triangle v has view-space coordinates, barycentric is a tuple consists of
+// the 3 weights on each vertex.
+using Shader = std::function<Color(
+    Triangle const &t, Triangle const &v,
+    std::tuple<flt, flt, flt> const &barycentric)>;
+
+// Shaders are also defined as function objects, so that rasterizers
+// templated on them inline the shader into their inner loops.
+
+// Normal shader
+struct Normal {
+    Color operator()(Triangle const & /* t */, Triangle const &v,
+                     std::tuple<flt, flt, flt> const & /* barycentric */)
+        const {
+        Color ret(.5 + .5 * (v.facing.x + 1.0) * 255,
+                  .5 + .5 * (v.facing.y + 1.0) * 255,
+                  .5 + .5 * (v.facing.z + 1.0) * 255);
+        return ret;
+    }
+};
+
+// Interpolate colors on vertices with barycentric coordinates
+struct VertexInterpolation {
+    Color operator()(Triangle const & /* t */, Triangle const &v,
+                     std::tuple<flt, flt, flt> const &barycentric) const {
+        auto [ca, cb, cc] = barycentric;
+        flt   real_z      = 1 / (ca / v.a().z + cb / v.b().z + cc / v.c().z);
+        Color ret         = v.color_at(ca, cb, cc, real_z);
+        return ret;
+    }
+};
+
 // Normal shader
 Color normal_shader(Triangle const &t, Triangle const &v,
                     std::tuple<flt, flt, flt> const &barycentric);
@@ -14,6 +49,17 @@ Color vertex_interpolation_shader(
     Triangle const &t, Triangle const &v,
     std::tuple<flt, flt, flt> const &barycentric);
 
+// Shaders in the registry, `custom` stands for any other shader.
+enum shader_id {
+    normal,               // `normal_shader`
+    vertex_interpolation, // `vertex_interpolation_shader`
+    custom,
+};
+
+// Look up the registry for the shader function wrapped in `shader`.
+// Returns `custom` if it wraps no registered shader.
+shader_id lookup(Shader const &shader);
+
 }; // namespace shdr
 
 // Author: Blurgy <gy@blurgy.xyz>
@@ -1,4 +1,6 @@
-#include "OBJ_Loader.hpp"
+#include "MappedFile.hpp"
+#include "ObjParser.hpp"
+#include "Profiler.hpp"
 #include "Scene.hpp"
 #include "Timer.hpp"
 #include "Triangle.hpp"
@@ -23,6 +25,9 @@ void show_help(char const *selfname) {
     printf("    usage: %s <objfile> [-r|--resolution <WxH>]\n", selfname + o);
     printf("                             [-f|--field-of-view <fov>]\n");
     printf("                             [-o|--output <path>]\n");
+    printf("                             [-l|--looseness <k>]\n");
+    printf("                             [-c|--cache <path>] [--no-cache]\n");
+    printf("                             [-t|--trace <path>]\n");
     printf("\n");
     printf("    options:\n");
     printf("        -h|--help                 Show this message and quit\n");
@@ -32,6 +37,18 @@ void show_help(char const *selfname) {
            "degrees), default: 45\n");
     printf("        -o|--output <path>        Save render result (ppm "
            "format) to <path>, default: zbuffer.ppm\n");
+    printf("        -l|--looseness <k>        Build a loose octree whose "
+           "cubes are expanded k\n"
+           "                                  times (k >= 1), default: 1 "
+           "(regular octree)\n");
+    printf("        -c|--cache <path>         Cache the built scene in "
+           "<path>, default: <objfile>.zbcache\n");
+    printf("        --no-cache                Always load the obj file and "
+           "build the scene\n");
+    printf("        -t|--trace <path>         Save profiled zones (chrome "
+           "trace format) to <path>,\n"
+           "                                  when built with -DPROFILER=ON, "
+           "default: zbuffer-trace.json\n");
     printf("\n");
 }
 
@@ -43,6 +60,12 @@ int main(int argc, char **argv) {
     std::string octree_outfile{"octree-zbuffer.ppm"};
     std::string zpyramid_outfile{"zpyramid-zbuffer.ppm"};
     std::string naive_outfile{"naive-zbuffer.ppm"};
+    std::string tiled_outfile{"tiled-zbuffer.ppm"};
+    std::string deferred_outfile{"deferred-zbuffer.ppm"};
+    std::string scanline_outfile{"scanline-zbuffer.ppm"};
+    std::string scanline_zpyramid_outfile{"scanline-zpyramid-zbuffer.ppm"};
+    std::string masked_outfile{"masked-zbuffer.ppm"};
+    std::string coherent_outfile{"coherent-zbuffer.ppm"};
     // Shader function to use
     std::function<Color(Triangle const &, Triangle const &,
                         std::tuple<flt, flt, flt> const &barycentric)>
@@ -53,6 +76,14 @@ int main(int argc, char **argv) {
     int height = 1080;
     // Field of view (in degrees)
     flt fovy = 45;
+    // Looseness factor of the octree
+    flt looseness = 1;
+    // Path of the scene cache, empty for `<objfile>.zbcache`
+    std::string cachefile;
+    // Whether to use the scene cache
+    bool use_cache = true;
+    // Path of the trace of profiled zones
+    std::string tracefile{"zbuffer-trace.json"};
 
     /*************************** Parse arguments ****************************/
     for (int i = 1; i < argc; ++i) {
@@ -107,6 +138,40 @@ int main(int argc, char **argv) {
                                outfile.substr(pos + 1);
             octree_outfile = outfile.substr(0, pos + 1) + "octree-" +
                              outfile.substr(pos + 1);
+            tiled_outfile = outfile.substr(0, pos + 1) + "tiled-" +
+                            outfile.substr(pos + 1);
+            deferred_outfile = outfile.substr(0, pos + 1) + "deferred-" +
+                               outfile.substr(pos + 1);
+            scanline_outfile = outfile.substr(0, pos + 1) + "scanline-" +
+                               outfile.substr(pos + 1);
+            scanline_zpyramid_outfile = outfile.substr(0, pos + 1) +
+                                        "scanline-zpyramid-" +
+                                        outfile.substr(pos + 1);
+            masked_outfile = outfile.substr(0, pos + 1) + "masked-" +
+                             outfile.substr(pos + 1);
+            coherent_outfile = outfile.substr(0, pos + 1) + "coherent-" +
+                               outfile.substr(pos + 1);
+        } else if (!strcmp(argv[i], "-l") ||
+                   !strcmp(argv[i], "--looseness")) {
+            ++i;
+            if (i >= argc) {
+                break;
+            }
+            looseness = std::max(1.0, atof(argv[i]));
+        } else if (!strcmp(argv[i], "-c") || !strcmp(argv[i], "--cache")) {
+            ++i;
+            if (i >= argc) {
+                break;
+            }
+            cachefile = argv[i];
+        } else if (!strcmp(argv[i], "--no-cache")) {
+            use_cache = false;
+        } else if (!strcmp(argv[i], "-t") || !strcmp(argv[i], "--trace")) {
+            ++i;
+            if (i >= argc) {
+                break;
+            }
+            tracefile = argv[i];
         } else if (argv[i][0] == '-') {
             fprintf(stderr, "Unrecognized option '%s'\n", argv[i]);
         } else {
@@ -119,13 +184,26 @@ int main(int argc, char **argv) {
     }
 
     /****************************** Load model ******************************/
-    objl::Loader loader;
-    debugm("loading object from file '%s' ..\n", objfile.c_str());
-    if (!loader.LoadFile(objfile)) {
-        errorm("Failed to load object from '%s'\n", objfile.c_str());
+    if (cachefile.size() == 0) {
+        cachefile = objfile + ".zbcache";
+    }
+    // The cache is keyed by the contents of the obj file.
+    uint64_t key = use_cache ? hash_file(objfile) : 0;
+    Scene    world;
+    if (use_cache && world.load(cachefile, key, looseness)) {
+        msg("Scene loaded from cache '%s'\n", cachefile.c_str());
+    } else {
+        ObjData obj;
+        debugm("loading object from file '%s' ..\n", objfile.c_str());
+        if (!parse_obj(objfile, obj)) {
+            errorm("Failed to load object from '%s'\n", objfile.c_str());
+        }
+        msg("Object loaded\n");
+        world = Scene{obj, looseness};
+        if (use_cache && !world.save(cachefile, key)) {
+            msg("Failed to write scene cache '%s'\n", cachefile.c_str());
+        }
     }
-    msg("Object loaded\n");
-    Scene world{loader.LoadedMeshes[0]};
 
     // Create a renderer on scene
     Zbuf zbuf{world, static_cast<size_t>(width), static_cast<size_t>(height)};
@@ -159,6 +237,7 @@ int main(int argc, char **argv) {
     timer.end();
     msg("Scene (%dx%d) rendered in %.0f milliseconds with naive zbuffer\n",
         width, height, timer.elapsedms());
+    zbuf.frame_stats().report();
     write_ppm(naive_outfile, zbuf.image());
 
     // Z-pyramid
@@ -168,6 +247,7 @@ int main(int argc, char **argv) {
     timer.end();
     msg("Scene (%dx%d) rendered in %.0f milliseconds with z-pyramid\n", width,
         height, timer.elapsedms());
+    zbuf.frame_stats().report();
     write_ppm(zpyramid_outfile, zbuf.image());
 
     // Octree
@@ -178,8 +258,82 @@ int main(int argc, char **argv) {
     msg("Scene (%dx%d) rendered in %.0f milliseconds with zpyramid and "
         "object-space octree\n",
         width, height, timer.elapsedms());
+    zbuf.frame_stats().report();
     write_ppm(octree_outfile, zbuf.image());
 
+    // Tiled
+    zbuf.reset();
+    timer.start();
+    zbuf.render(rendering_method::tiled);
+    timer.end();
+    msg("Scene (%dx%d) rendered in %.0f milliseconds with zpyramid and "
+        "parallel screen tiles\n",
+        width, height, timer.elapsedms());
+    zbuf.frame_stats().report();
+    write_ppm(tiled_outfile, zbuf.image());
+
+    // Deferred
+    zbuf.reset();
+    timer.start();
+    zbuf.render(rendering_method::deferred);
+    timer.end();
+    msg("Scene (%dx%d) rendered in %.0f milliseconds with zpyramid and "
+        "deferred shading\n",
+        width, height, timer.elapsedms());
+    zbuf.frame_stats().report();
+    write_ppm(deferred_outfile, zbuf.image());
+
+    // Scanline
+    zbuf.reset();
+    timer.start();
+    zbuf.render(rendering_method::scanline);
+    timer.end();
+    msg("Scene (%dx%d) rendered in %.0f milliseconds with scanline zbuffer\n",
+        width, height, timer.elapsedms());
+    zbuf.frame_stats().report();
+    write_ppm(scanline_outfile, zbuf.image());
+
+    // Scanline, with z-pyramid
+    zbuf.reset();
+    timer.start();
+    zbuf.render(rendering_method::scanline_zpyramid);
+    timer.end();
+    msg("Scene (%dx%d) rendered in %.0f milliseconds with scanline zbuffer "
+        "and z-pyramid\n",
+        width, height, timer.elapsedms());
+    zbuf.frame_stats().report();
+    write_ppm(scanline_zpyramid_outfile, zbuf.image());
+
+    // Octree, with occluders drawn into a masked depth buffer first
+    zbuf.reset();
+    timer.start();
+    zbuf.render(rendering_method::masked);
+    timer.end();
+    msg("Scene (%dx%d) rendered in %.0f milliseconds with zpyramid, "
+        "object-space octree and masked occluders\n",
+        width, height, timer.elapsedms());
+    zbuf.frame_stats().report();
+    write_ppm(masked_outfile, zbuf.image());
+
+    // Octree, nodes visible in the previous (octree) frames drawn first
+    zbuf.reset();
+    timer.start();
+    zbuf.render(rendering_method::coherent);
+    timer.end();
+    msg("Scene (%dx%d) rendered in %.0f milliseconds with zpyramid and "
+        "coherent hierarchical culling\n",
+        width, height, timer.elapsedms());
+    zbuf.frame_stats().report();
+    write_ppm(coherent_outfile, zbuf.image());
+
+    /****************************** Profiling *******************************/
+    if (PROFILING) {
+        Profiler::instance().report();
+        if (Profiler::instance().write_trace(tracefile)) {
+            msg("Trace saved in %s\n", tracefile.c_str());
+        }
+    }
+
     return 0;
 }
 
@@ -0,0 +1 @@
+../../pa1/include/MappedFile.cpp
\ No newline at end of file
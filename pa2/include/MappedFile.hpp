@@ -0,0 +1 @@
+../../pa1/include/MappedFile.hpp
\ No newline at end of file
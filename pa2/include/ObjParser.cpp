@@ -0,0 +1 @@
+../../pa1/include/ObjParser.cpp
\ No newline at end of file
@@ -0,0 +1 @@
+../../pa1/include/ObjParser.hpp
\ No newline at end of file
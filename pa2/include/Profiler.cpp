@@ -0,0 +1 @@
+../../pa1/include/Profiler.cpp
\ No newline at end of file
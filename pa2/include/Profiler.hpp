@@ -0,0 +1 @@
+../../pa1/include/Profiler.hpp
\ No newline at end of file
@@ -1,4 +1,5 @@
 #include "Scene.hpp"
+#include "Profiler.hpp"
 
 Scene::Scene() {}
 Scene::Scene(tinyobj::ObjReader const &loader) : root{nullptr} {
@@ -42,6 +43,46 @@ Scene::Scene(tinyobj::ObjReader const &loader) : root{nullptr} {
     }
 }
 
+Scene::Scene(ObjData const &obj,
+             std::vector<tinyobj::material_t> const &materials,
+             std::map<std::string, int> const &      material_map)
+    : root{nullptr} {
+    profm("assemble triangles");
+    // Index into `materials` of each material used in the obj file
+    std::vector<int> matids;
+    for (std::string const &name : obj.material_names) {
+        auto it = material_map.find(name);
+        matids.push_back(it == material_map.end() ? -1 : it->second);
+    }
+    // Black material, like those initialized by tinyobjloader
+    tinyobj::material_t default_material{};
+    default_material.shininess = 1;
+    this->orig_tris.resize(obj.ntriangles());
+#pragma omp parallel for
+    for (std::size_t t = 0; t < obj.ntriangles(); ++t) {
+        std::array<vec3, 3> vtx, nor;
+        std::array<vec2, 3> tex;
+        for (int v = 0; v < 3; ++v) {
+            ObjIndex const &idx = obj.corners[3 * t + v];
+            vtx[v]              = obj.position(t, v);
+            if (idx.vn >= 0) {
+                nor[v] = vec3{obj.normals[3 * idx.vn + 0],
+                              obj.normals[3 * idx.vn + 1],
+                              obj.normals[3 * idx.vn + 2]};
+            }
+            if (idx.vt >= 0) {
+                tex[v] = vec2{obj.texcoords[2 * idx.vt + 0],
+                              obj.texcoords[2 * idx.vt + 1]};
+            }
+        }
+        int const &m     = obj.material_ids[t];
+        int        matid = m < 0 ? -1 : matids[m];
+        Triangle   newtri{vtx, nor, tex};
+        newtri.set_material(matid < 0 ? default_material : materials[matid]);
+        this->orig_tris[t] = newtri;
+    }
+}
+
 /* public */
 
 void Scene::load_skybox(std::string const &imgfile) {
@@ -49,6 +90,7 @@ void Scene::load_skybox(std::string const &imgfile) {
 }
 
 void Scene::to_camera_space(Camera const &cam) {
+    profm("to camera space");
     this->tris.clear();
     this->lights.clear();
     this->area_of_lights = 0;
@@ -64,6 +106,7 @@ void Scene::to_camera_space(Camera const &cam) {
 }
 
 void Scene::build_BVH() {
+    profm("build BVH");
     if (this->root) {
         delete this->root;
     }
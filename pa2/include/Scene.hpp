@@ -1,6 +1,7 @@
 #pragma once
 
 #include "Camera.hpp"
+#include "ObjParser.hpp"
 #include "Ray.hpp"
 #include "SkyBox.hpp"
 #include "Triangle.hpp"
@@ -8,6 +9,7 @@
 #include "tinyobjloader/tiny_obj_loader.h"
 
 #include <algorithm>
+#include <map>
 #include <vector>
 
 // Node for constructing BVH.
@@ -131,6 +133,13 @@ class Scene {
   public:
     Scene();
     Scene(tinyobj::ObjReader const &loader);
+    // Construct a scene with geometry parsed by `parse_obj`, and materials
+    // loaded by `tinyobj::LoadMtl`.  Triangles whose material is missing
+    // get a default material.
+    // @param material_map: Index into `materials` of each material name
+    Scene(ObjData const &                          obj,
+          std::vector<tinyobj::material_t> const &materials,
+          std::map<std::string, int> const &      material_map);
 
     void load_skybox(std::string const &imgfile);
 
@@ -1,3 +1,4 @@
+#include "Profiler.hpp"
 #include "Ray.hpp"
 #include "Screen.hpp"
 
@@ -19,7 +20,8 @@ void Screen::set_cam(Camera const &cam) { this->cam = cam; }
 void Screen::set_gamma(flt const &gamma) { this->gamma = gamma; }
 
 void Screen::render(flt const &rr, std::string const &outputfile,
-                    int const &iterations) {
+                    int const &iterations, std::string const &rawfile) {
+    profm("render");
     this->sce.to_camera_space(this->cam);
 
     flt yscale = std::tan(this->cam.fovy() / 2 * degree);
@@ -31,9 +33,11 @@ void Screen::render(flt const &rr, std::string const &outputfile,
     this->sce.build_BVH();
     this->iter = 0;
     while (this->iter < iterations) {
+        profm("iteration");
         std::atomic<std::size_t> progress{0};
 #pragma omp parallel for schedule(dynamic)
         for (std::size_t i = 0; i < this->w; ++i) {
+            profm("column");
             for (std::size_t j = 0; j < this->h; ++j) {
                 flt x = (2 * (i + 0.5) / this->w - 1) * xscale;
                 flt y = (2 * (j + 0.5) / this->h - 1) * yscale;
@@ -52,15 +56,26 @@ void Screen::render(flt const &rr, std::string const &outputfile,
         }
         ++this->iter;
         write_ppm(outputfile, this->image(), this->gamma);
+        if (rawfile.size() > 0) {
+            write_pfm(rawfile, this->raw_image());
+        }
     }
 }
 
 Image Screen::image() const {
     Image ret(this->w, this->h);
-    for (int i = 0; i < this->w; ++i) {
-        for (int j = 0; j < this->h; ++j) {
-            ret(i, j) = Color(this->img(i, j) / static_cast<flt>(this->iter));
-        }
+#pragma omp parallel for
+    for (std::size_t k = 0; k < this->w * this->h; ++k) {
+        ret.data[k] = Color(this->img.data[k] / static_cast<flt>(this->iter));
+    }
+    return ret;
+}
+
+Image_t<vec3> Screen::raw_image() const {
+    Image_t<vec3> ret(this->w, this->h);
+#pragma omp parallel for
+    for (std::size_t k = 0; k < this->w * this->h; ++k) {
+        ret.data[k] = this->img.data[k] / static_cast<flt>(this->iter);
     }
     return ret;
 }
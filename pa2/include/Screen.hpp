@@ -29,10 +29,15 @@ class Screen {
     void set_cam(Camera const &cam);
     void set_gamma(flt const &gamma);
 
+    // Render the scene progressively, the averaged result is saved to
+    // `outputfile` (ppm format) after every iteration, and to `rawfile`
+    // (pfm format, without gamma correction) if it is not empty.
     void render(flt const &rr, std::string const &outputfile,
-                int const &iterations);
+                int const &iterations, std::string const &rawfile = "");
 
     Image image() const;
+    // Averaged radiance of each pixel.
+    Image_t<vec3> raw_image() const;
 };
 
 // Author: Blurgy <gy@blurgy.xyz>
@@ -1,4 +1,6 @@
 #include "Camera.hpp"
+#include "ObjParser.hpp"
+#include "Profiler.hpp"
 #include "Scene.hpp"
 #include "Screen.hpp"
 #include "Timer.hpp"
@@ -9,6 +11,7 @@
 
 #include <csignal>
 #include <filesystem>
+#include <fstream>
 #include <iostream>
 #include <thread>
 
@@ -20,7 +23,9 @@ void usage(char *const executable) {
             "                   [-r|--resolution <width>x<height>]\n"
             "                   [-g|--gamma <gamma>]\n"
             "                   [-i|--iterations <iterations>]\n"
-            "                   [-rr <probability>]\n",
+            "                   [-rr <probability>]\n"
+            "                   [-p|--pfm]\n"
+            "                   [-t|--trace <trace.json>]\n",
             executable);
 }
 
@@ -50,6 +55,13 @@ int main(int argc, char **argv) {
 
     int iterations = 8;
 
+    // Whether to save the raw (linear) result as a pfm file as well.
+    bool pfm = false;
+
+    // Path of the trace of profiled zones, only written when built with
+    // `-DPROFILER=ON`.
+    std::string tracefile{"pbr-trace.json"};
+
     /* [Parse arguments] */
     for (int i = 1; i < argc; ++i) {
         if (!strcmp(argv[i], "-c") || !strcmp(argv[i], "--config")) {
@@ -98,6 +110,14 @@ int main(int argc, char **argv) {
                 break;
             }
             iterations = std::atoi(argv[i]);
+        } else if (!strcmp(argv[i], "-p") || !strcmp(argv[i], "--pfm")) {
+            pfm = true;
+        } else if (!strcmp(argv[i], "-t") || !strcmp(argv[i], "--trace")) {
+            ++i;
+            if (i >= argc) {
+                break;
+            }
+            tracefile = std::string{argv[i]};
         } else {
             objmodel = std::string{argv[i]};
         }
@@ -128,20 +148,25 @@ int main(int argc, char **argv) {
     flt aspect_ratio = static_cast<flt>(width) / static_cast<flt>(height);
 
     /* [Read object file] */
-    tinyobj::ObjReader       loader;
-    tinyobj::ObjReaderConfig config;
-    // Search from the same directory of the objfile.
-    config.mtl_search_path = "";
-    // Triangulate polygon.
-    config.triangulate = true;
-    // Parse vertex colors, fill default color when no color is present in the
-    // objfile.
-    config.vertex_color = true;
-    loader.ParseFromFile(objmodel, config);
+    ObjData obj;
+    if (!parse_obj(objmodel, obj)) {
+        errorm("Failed to load object from '%s'\n", objmodel.c_str());
+    }
+    // Material libraries are small, read them with tinyobjloader.  They are
+    // searched from the same directory of the objfile.
+    std::vector<tinyobj::material_t> materials;
+    std::map<std::string, int>       material_map;
+    for (std::string const &mtllib : obj.mtllibs) {
+        std::ifstream mtl_input(
+            std::filesystem::path(objmodel).replace_filename(mtllib));
+        std::string warning, error;
+        tinyobj::LoadMtl(&material_map, &materials, &mtl_input, &warning,
+                         &error);
+    }
     /* [/Read object file] */
 
     /* [Load model] */
-    Scene world(loader);
+    Scene world(obj, materials, material_map);
     /* [/Load model] */
 
     /* [Setup scene] */
@@ -164,13 +189,17 @@ int main(int argc, char **argv) {
     screen.set_cam(camera);
 
     msg("Rendering scene ..\n");
-    screen.render(rr,
-                  std::filesystem::path(objmodel)
-                          .filename()
-                          .replace_extension()
-                          .string() +
-                      ".ppm",
-                  iterations);
+    std::string outputname =
+        std::filesystem::path(objmodel).filename().replace_extension();
+    screen.render(rr, outputname + ".ppm", iterations,
+                  pfm ? outputname + ".pfm" : "");
+
+    if (PROFILING) {
+        Profiler::instance().report();
+        if (Profiler::instance().write_trace(tracefile)) {
+            msg("Trace saved in %s\n", tracefile.c_str());
+        }
+    }
 
     return 0;
 }